@@ -1,247 +1,5923 @@
 /**
  * @file
- * @brief head utility
+ * @brief head library
  * @author James Humphrey (humphreyj@somnisoft.com)
  *
  * This software has been placed into the public domain using CC0.
  */
 
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "head.h"
+
+#ifdef HEAD_ZLIB
+# include <zlib.h>
+#endif /* HEAD_ZLIB */
+
+#ifdef __linux__
+/**
+ * Build the io_uring backend for printing many files.
+ */
+# define HEAD_URING
+# include <linux/io_uring.h>
+# include <sys/syscall.h>
+#endif /* __linux__ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/**
+ * Build the SSE2 and AVX2 delimiter scanning kernels.
+ */
+# define HEAD_SCAN_X86
+# include <immintrin.h>
+#endif /* __GNUC__ && (__x86_64__ || __i386__) */
+
+#ifdef TEST
+/**
+ * Declare some functions with extern linkage, allowing the test suite to call
+ * those functions.
+ */
+# define LINKAGE extern
+# include "../test/seams.h"
+#else /* !(TEST) */
+/**
+ * Define all functions as static when not testing.
+ */
+# define LINKAGE static
+#endif /* TEST */
+
+#ifdef HEAD_SDT
+# include <sys/sdt.h>
+/**
+ * Fire a USDT probe of the head provider with one argument.
+ *
+ * Each probe site compiles to a single nop plus a note in the ELF file,
+ * so probes cost nothing until a tracer attaches to them. Probes:
+ *   - file__open(path, fd)       File opened by @ref head_path.
+ *   - file__close(path, status)  File closed by @ref head_path.
+ *   - read(fd, nread)            Block read by read() or pread().
+ *   - write(nwrite)              Bytes written to STDOUT by writev().
+ *   - copy(engine, ncopy)        Bytes copied to STDOUT by the kernel.
+ *   - engine(name)               Engine first used for the current file.
+ *   - error(fmt, errnum)         Error reported by @ref head_warn.
+ */
+# define HEAD_PROBE1(name, a) STAP_PROBE1(head, name, a)
+
+/**
+ * Fire a USDT probe of the head provider with two arguments.
+ */
+# define HEAD_PROBE2(name, a, b) STAP_PROBE2(head, name, a, b)
+#else /* !(HEAD_SDT) */
+/**
+ * Probes compiled out without sys/sdt.h.
+ */
+# define HEAD_PROBE1(name, a) ((void)0)
+
+/**
+ * Probes compiled out without sys/sdt.h.
+ */
+# define HEAD_PROBE2(name, a, b) ((void)0)
+#endif /* HEAD_SDT */
+
+/**
+ * Default number of lines to print if -n argument unspecified.
+ */
+#define HEAD_DEFAULT_LINES (10)
+
+/**
+ * Number of bytes requested from each read() call in @ref head_fd.
+ */
+#define HEAD_BLOCK_SIZE (128 * 1024)
+
+/**
+ * Maximum number of bytes mapped at once by @ref head_mmap.
+ *
+ * Must be a multiple of the page size.
+ */
+#define HEAD_MMAP_WINDOW (16 * 1024 * 1024)
+
+#ifdef TEST
+/**
+ * Value of @ref HEAD_MMAP_WINDOW, which bounds the memory use checked by
+ * the test suite.
+ */
+const size_t g_head_mmap_window = HEAD_MMAP_WINDOW;
+#endif /* TEST */
+
+/**
+ * Maximum number of bytes passed to a single kernel copy system call.
+ */
+#define HEAD_COPY_CHUNK (1024 * 1024 * 1024)
+
+/**
+ * Maximum size of a file range written together with a pending file banner
+ * by @ref head_write instead of getting copied by @ref head_copy.
+ */
+#define HEAD_COALESCE_MAX (64 * 1024)
+
+/**
+ * Number of files opened and read at once by @ref head_uring_run.
+ */
+#define HEAD_URING_DEPTH (32)
+
+/**
+ * Number of bytes read from each file by @ref head_uring_run before
+ * continuing with @ref head_fd.
+ */
+#define HEAD_URING_WINDOW (64 * 1024)
+
+/**
+ * Minimum number of file operands for which setting up io_uring pays off.
+ */
+#define HEAD_URING_MIN_FILES (8)
+
+/**
+ * Number of lines between the offsets saved in a line-offset index, see
+ * @ref head_index.
+ */
+#define HEAD_INDEX_INTERVAL (16384)
+
+/**
+ * Value of the first field in an index file, "HEADIDX1" in ASCII.
+ */
+#define HEAD_INDEX_MAGIC (((uint64_t)0x48454144UL << 32) | 0x49445831UL)
+
+/**
+ * Maximum number of worker threads allowed by the (-j) and
+ * (--scan-threads) arguments.
+ */
+#define HEAD_JOBS_MAX (1024)
+
+/**
+ * Size of the chunks of a regular file counted in parallel by
+ * @ref head_pscan.
+ *
+ * Must be a multiple of the page size.
+ */
+#define HEAD_PSCAN_CHUNK (16 * 1024 * 1024)
+
+/**
+ * Minimum number of chunks in a regular file for counting its lines in
+ * parallel.
+ */
+#define HEAD_PSCAN_MIN_CHUNKS (4)
+
 #ifdef TEST
 /**
- * Declare some functions with extern linkage, allowing the test suite to call
- * those functions.
+ * Chunk size used by @ref head_pscan, which the test suite lowers so that
+ * its test files split into several chunks.
+ */
+size_t g_head_pscan_chunk = HEAD_PSCAN_CHUNK;
+#else /* !(TEST) */
+/**
+ * Chunk size used by @ref head_pscan.
+ */
+static const size_t g_head_pscan_chunk = HEAD_PSCAN_CHUNK;
+#endif /* TEST */
+
+/**
+ * Number of paths read at once from a (--files-from) list.
+ */
+#define HEAD_FILES_BATCH (256)
+
+/**
+ * Number of open files kept by (--serve), see @ref head_cache.
+ */
+#define HEAD_CACHE_SIZE (64)
+
+/**
+ * Maximum size of a request sent to (--serve), see @ref head_serve.
+ */
+#define HEAD_SERVE_MSG_MAX (64 * 1024)
+
+/**
+ * Seconds a connection to (--serve) may stay idle between requests.
+ */
+#define HEAD_SERVE_TIMEOUT (5)
+
+/**
+ * Maximum number of file operands kept open by @ref head_serial, counting
+ * the file being printed.
+ */
+#define HEAD_PREFETCH_FILES (8)
+
+/**
+ * Estimated number of bytes per line, which sets how much of an upcoming
+ * file @ref head_prefetch reads ahead for the (-n) argument.
+ */
+#define HEAD_PREFETCH_LINE (128)
+
+/**
+ * Maximum number of bytes of an upcoming file read ahead by
+ * @ref head_prefetch, see @ref head_serial.
+ */
+#define HEAD_PREFETCH_MAX (2 * 1024 * 1024)
+
+/**
+ * First line of a (--resume) state file.
+ */
+#define HEAD_RESUME_MAGIC "head-resume 1\n"
+
+/**
+ * Values returned by getopt_long() for options without a short form.
+ */
+enum head_opt{
+  /**
+   * The (--index-dir) argument.
+   */
+  HEAD_OPT_INDEX_DIR = 256,
+
+  /**
+   * The (--stats) argument.
+   */
+  HEAD_OPT_STATS,
+
+  /**
+   * The (--scan-threads) argument.
+   */
+  HEAD_OPT_SCAN_THREADS,
+
+  /**
+   * The (--files-from) argument.
+   */
+  HEAD_OPT_FILES_FROM,
+
+  /**
+   * The (--files0-from) argument.
+   */
+  HEAD_OPT_FILES0_FROM,
+
+  /**
+   * The (--serve) argument.
+   */
+  HEAD_OPT_SERVE,
+
+  /**
+   * The (--client) argument.
+   */
+  HEAD_OPT_CLIENT,
+
+  /**
+   * The (--resume) argument.
+   */
+  HEAD_OPT_RESUME,
+
+  /**
+   * The (--decompress) argument.
+   */
+  HEAD_OPT_DECOMPRESS
+};
+
+/**
+ * File descriptors passed with each request to (--serve), in order.
+ */
+enum head_serve_fd{
+  /**
+   * STDIN of the client.
+   */
+  HEAD_SERVE_FD_IN,
+
+  /**
+   * STDOUT of the client.
+   */
+  HEAD_SERVE_FD_OUT,
+
+  /**
+   * STDERR of the client.
+   */
+  HEAD_SERVE_FD_ERR,
+
+  /**
+   * Working directory of the client.
+   */
+  HEAD_SERVE_FD_CWD,
+
+  /**
+   * Number of file descriptors.
+   */
+  HEAD_SERVE_NFDS
+};
+
+/**
+ * System call used to copy file ranges to STDOUT inside the kernel.
+ */
+enum head_copy{
+  /**
+   * Kernel copy unavailable, write the bytes from user space.
+   */
+  HEAD_COPY_NONE,
+
+  /**
+   * STDOUT is a regular file, use copy_file_range().
+   */
+  HEAD_COPY_FILE_RANGE,
+
+  /**
+   * STDOUT is a pipe, use splice().
+   */
+  HEAD_COPY_SPLICE,
+
+  /**
+   * STDOUT is another file type such as a socket or device, use sendfile().
+   */
+  HEAD_COPY_SENDFILE
+};
+
+/**
+ * Ways of getting input bytes to STDOUT, reported by (--stats) as the
+ * engines used for a file. Each value is a bit number in
+ * @ref head_stats::engines.
+ */
+enum head_engine{
+  /**
+   * Blocks read with read(), see @ref head_fd.
+   */
+  HEAD_ENGINE_READ,
+
+  /**
+   * Blocks read with pread(), see @ref head_pread.
+   */
+  HEAD_ENGINE_PREAD,
+
+  /**
+   * Windows scanned through a memory mapping, see @ref head_mmap.
+   */
+  HEAD_ENGINE_MMAP,
+
+  /**
+   * Ranges copied with copy_file_range(), see @ref head_copy.
+   */
+  HEAD_ENGINE_COPY_FILE_RANGE,
+
+  /**
+   * Ranges copied with splice().
+   */
+  HEAD_ENGINE_SPLICE,
+
+  /**
+   * Ranges copied with sendfile().
+   */
+  HEAD_ENGINE_SENDFILE,
+
+  /**
+   * First window read through io_uring, see @ref head_uring_run.
+   */
+  HEAD_ENGINE_URING,
+
+  /**
+   * Data decompressed from a gzip file, see @ref head_gz.
+   */
+  HEAD_ENGINE_GZIP,
+
+  /**
+   * Lines skipped with a line-offset index, see @ref head_index.
+   */
+  HEAD_ENGINE_INDEX,
+
+  /**
+   * Holes of a sparse file skipped and written as zeros, see
+   * @ref head_hole.
+   */
+  HEAD_ENGINE_HOLE,
+
+  /**
+   * Lines counted by multiple threads, see @ref head_pscan.
+   */
+  HEAD_ENGINE_PSCAN,
+
+  /**
+   * Number of engines.
+   */
+  HEAD_ENGINE_COUNT
+};
+
+/**
+ * Counters reported by (--stats) for one file or for all files.
+ *
+ * The counters get updated whether or not (--stats) has been given, which
+ * costs no more than an addition per system call. Only the clocks and the
+ * report depend on @ref head::stats_fp.
+ */
+struct head_stats{
+  /**
+   * Number of input bytes taken by read calls, written from memory
+   * mappings, or copied by the kernel.
+   */
+  uintmax_t bytes_read;
+
+  /**
+   * Number of bytes written to STDOUT, including file banners.
+   */
+  uintmax_t bytes_written;
+
+  /**
+   * Number of complete lines written, see @ref lines_known.
+   */
+  uintmax_t lines;
+
+  /**
+   * Number of read(), pread() and io_uring read calls.
+   */
+  uintmax_t nread;
+
+  /**
+   * Number of writev() and kernel copy calls.
+   */
+  uintmax_t nwrite;
+
+  /**
+   * Wall time in seconds, holding the start time while in progress.
+   */
+  double wall;
+
+  /**
+   * CPU time in seconds, holding the start time while in progress.
+   */
+  double cpu;
+
+  /**
+   * Bit set of @ref head_engine values used.
+   */
+  unsigned int engines;
+
+  /**
+   * Cleared when @ref lines cannot be known because the lines got printed
+   * without counting them, or when printing bytes or all but the last
+   * lines.
+   */
+  bool lines_known;
+
+  /**
+   * Padding for alignment.
+   */
+  char pad[3];
+};
+
+/**
+ * Output collected in memory instead of getting written to STDOUT.
+ */
+struct head_obuf{
+  /**
+   * Collected bytes.
+   */
+  char *data;
+
+  /**
+   * Number of bytes in @ref data.
+   */
+  size_t len;
+
+  /**
+   * Number of bytes allocated in @ref data.
+   */
+  size_t size;
+};
+
+/**
+ * Head utility context.
+ */
+struct head{
+  /**
+   * Exit status set to one of the following values.
+   *   - EXIT_SUCCESS
+   *   - EXIT_FAILURE
+   */
+  int status_code;
+
+  /**
+   * Kernel copy method for STDOUT, see @ref head_copy_init.
+   */
+  enum head_copy copy;
+
+  /**
+   * Number of initial lines to write in each file.
+   *
+   * Corresponds to the (-n) argument.
+   */
+  uintmax_t nlines;
+
+  /**
+   * Number of initial bytes to write in each file.
+   *
+   * Corresponds to the (-c) argument.
+   */
+  uintmax_t nbytes;
+
+  /**
+   * Number of lines, or bytes if @ref bytes set, still to write from the
+   * current file.
+   */
+  uintmax_t remain;
+
+  /**
+   * Block buffer used by @ref head_fd, allocated on first use and reused
+   * for every file.
+   */
+  char *buf;
+
+  /**
+   * If set, collect all output in this buffer instead of writing it to
+   * STDOUT.
+   */
+  struct head_obuf *obuf;
+
+  /**
+   * File banner waiting to get written to STDOUT together with the first
+   * bytes of the file, see @ref head_banner.
+   */
+  struct head_obuf hdr;
+
+  /**
+   * If set, pass all output to this callback instead of writing it to
+   * STDOUT, see @ref head_set_sink.
+   */
+  head_sink_fn sink;
+
+  /**
+   * Argument passed to @ref sink.
+   */
+  void *sink_arg;
+
+  /**
+   * Directory holding the line-offset index files, or NULL to not use
+   * any index.
+   *
+   * Corresponds to the (--index-dir) argument.
+   */
+  const char *index_dir;
+
+  /**
+   * Open files shared by the threads serving requests, or NULL if not
+   * serving a request, see @ref head_serve.
+   */
+  struct head_cache *cache;
+
+  /**
+   * Entry of @ref cache holding the current file, or NULL if the file did
+   * not get opened through the cache.
+   */
+  struct head_cache_entry *cached;
+
+  /**
+   * Checkpoints of the files printed since the previous run, or NULL to
+   * print from the start of each file.
+   *
+   * Corresponds to the (--resume) argument.
+   */
+  struct head_resume *resume;
+
+  /**
+   * Counters of the file being printed.
+   */
+  struct head_stats stats;
+
+  /**
+   * Counters summed over all files reported so far, with the start times
+   * of the whole run.
+   */
+  struct head_stats total;
+
+  /**
+   * Stream receiving the (--stats) report, or NULL if not reporting.
+   */
+  FILE *stats_fp;
+
+  /**
+   * Number of files reported to @ref stats_fp.
+   */
+  size_t stats_nfiles;
+
+  /**
+   * Number of files to process in parallel.
+   *
+   * Corresponds to the (-j) argument.
+   */
+  size_t jobs;
+
+  /**
+   * Number of threads counting the lines of a large regular file, or 1 to
+   * scan every file in a single thread.
+   *
+   * Corresponds to the (--scan-threads) argument.
+   */
+  size_t scan_threads;
+
+  /**
+   * Number of files printed before the current batch, so that only the
+   * very first banner goes without a blank line in front.
+   */
+  size_t nfiles;
+
+  /**
+   * File descriptor read when no file operand is given, STDIN unless
+   * serving a request, see @ref head_serve.
+   */
+  int in;
+
+  /**
+   * File descriptor receiving the output, STDOUT unless serving a
+   * request.
+   */
+  int out;
+
+  /**
+   * File descriptor receiving error messages, STDERR unless serving a
+   * request.
+   */
+  int err;
+
+  /**
+   * Write @ref nbytes bytes instead of @ref nlines lines.
+   *
+   * Set by the last (-c) or (-n) argument.
+   */
+  bool bytes;
+
+  /**
+   * Write all but the last @ref nlines lines or @ref nbytes bytes.
+   *
+   * Set by a negative (-c) or (-n) argument.
+   */
+  bool elide;
+
+  /**
+   * Byte ending each line, a newline unless changed by the (-d) or (-z)
+   * arguments.
+   */
+  char delim;
+
+  /**
+   * The current regular file has fewer blocks allocated than its size
+   * needs, so it may contain holes, see @ref head_hole_end.
+   */
+  bool sparse;
+
+  /**
+   * Decompress regular files starting with the gzip magic bytes, set by
+   * the (--decompress) argument.
+   */
+  bool decompress;
+};
+
+/**
+ * Print an error message to @ref head::err and set an error status code.
+ *
+ * Worker threads of the pool and of the server call this concurrently, so
+ * the errno message comes from strerror_r.
+ *
+ * @param[in,out] head      See @ref head.
+ * @param[in]     errno_msg Include a standard message describing errno.
+ * @param[in]     fmt       Format string used by vsnprintf.
+ */
+static void
+head_warn(struct head *const head,
+          const bool errno_msg,
+          const char *const fmt, ...){
+  va_list ap;
+  char msg[512];
+  char errbuf[128];
+  const char *errstr;
+  int errnum;
+
+  errnum = errno;
+  head->status_code = EXIT_FAILURE;
+  HEAD_PROBE2(error, fmt, errno_msg ? errnum : 0);
+  va_start(ap, fmt);
+  vsnprintf(msg, sizeof(msg), fmt, ap);
+  va_end(ap);
+  errstr = errno_msg ? strerror_r(errnum, errbuf, sizeof(errbuf)) : "";
+  if(head->err != STDERR_FILENO){
+    dprintf(head->err,
+            "%s: %s%s%s\n",
+            program_invocation_short_name,
+            msg,
+            errno_msg ? ": " : "",
+            errstr);
+  }
+  else{
+    warnx("%s%s%s", msg, errno_msg ? ": " : "", errstr);
+  }
+}
+
+/**
+ * Reset the number of lines or bytes still to write before a new file.
+ *
+ * @param[in,out] head See @ref head.
+ */
+static void
+head_reset(struct head *const head){
+  if(head->bytes){
+    head->remain = head->nbytes;
+  }
+  else{
+    head->remain = head->nlines;
+  }
+}
+
+/**
+ * Names of the @ref head_engine values in the (--stats) report.
+ */
+static const char *const
+head_engine_names[HEAD_ENGINE_COUNT] = {
+  "read",
+  "pread",
+  "mmap",
+  "copy_file_range",
+  "splice",
+  "sendfile",
+  "io_uring",
+  "gzip",
+  "index",
+  "hole",
+  "pscan"
+};
+
+/**
+ * Read a clock in seconds.
+ *
+ * @param[in] clk Clock to read.
+ * @return        Clock time in seconds, or 0 if the clock is unavailable.
+ */
+static double
+head_clock(const clockid_t clk){
+  struct timespec ts;
+
+  if(clock_gettime(clk, &ts) != 0){
+    return 0;
+  }
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000L;
+}
+
+/**
+ * Reset the (--stats) counters before a new file.
+ *
+ * @param[in,out] head See @ref head.
+ */
+static void
+head_stats_begin(struct head *const head){
+  memset(&head->stats, 0, sizeof(head->stats));
+  head->stats.lines_known = true;
+  if(head->stats_fp){
+    head->stats.wall = head_clock(CLOCK_MONOTONIC);
+    head->stats.cpu = head_clock(CLOCK_THREAD_CPUTIME_ID);
+  }
+}
+
+/**
+ * Record the use of an engine for the current file.
+ *
+ * @param[in,out] head   See @ref head.
+ * @param[in]     engine Engine used.
+ */
+static void
+head_engine(struct head *const head,
+            const enum head_engine engine){
+  if((head->stats.engines & (1u << engine)) == 0){
+    head->stats.engines |= 1u << engine;
+    HEAD_PROBE1(engine, head_engine_names[engine]);
+  }
+}
+
+/**
+ * Write a string to the (--stats) report as a JSON string.
+ *
+ * File names are bytes, not necessarily valid UTF-8, so control bytes and
+ * bytes from 0x80 get written as \\u00XX escapes, keeping the report valid
+ * JSON. Each byte maps to the Unicode code point of the same value.
+ *
+ * @param[in] fp Report stream.
+ * @param[in] s  String to quote.
+ */
+static void
+head_stats_string(FILE *const fp,
+                  const char *s){
+  putc('"', fp);
+  for(; *s != '\0'; s++){
+    if(*s == '"' || *s == '\\'){
+      fprintf(fp, "\\%c", *s);
+    }
+    else if((unsigned char)*s < 0x20 || (unsigned char)*s >= 0x80){
+      fprintf(fp, "\\u%04x", (unsigned int)(unsigned char)*s);
+    }
+    else{
+      putc(*s, fp);
+    }
+  }
+  putc('"', fp);
+}
+
+/**
+ * Write the members of a JSON object holding counters to the (--stats)
+ * report.
+ *
+ * @param[in] fp    Report stream.
+ * @param[in] stats Counters to write.
+ */
+static void
+head_stats_fields(FILE *const fp,
+                  const struct head_stats *const stats){
+  const char *sep;
+  int i;
+
+  fputs("\"engines\":[", fp);
+  sep = "";
+  for(i = 0; i < HEAD_ENGINE_COUNT; i++){
+    if(stats->engines & (1u << i)){
+      fprintf(fp, "%s\"%s\"", sep, head_engine_names[i]);
+      sep = ",";
+    }
+  }
+  fprintf(fp,
+          "],\"bytes_read\":%lu,\"bytes_written\":%lu,\"lines\":",
+          (unsigned long)stats->bytes_read,
+          (unsigned long)stats->bytes_written);
+  if(stats->lines_known){
+    fprintf(fp, "%lu", (unsigned long)stats->lines);
+  }
+  else{
+    fputs("null", fp);
+  }
+  fprintf(fp,
+          ",\"reads\":%lu,\"writes\":%lu,\"wall\":%.6f,\"cpu\":%.6f",
+          (unsigned long)stats->nread,
+          (unsigned long)stats->nwrite,
+          stats->wall,
+          stats->cpu);
+}
+
+/**
+ * Add the counters of a file to the (--stats) report and to the totals.
+ *
+ * @param[in,out] head  See @ref head.
+ * @param[in]     name  File name.
+ * @param[in]     stats Counters of the file, see @ref head_stats_end.
+ */
+static void
+head_stats_report(struct head *const head,
+                  const char *const name,
+                  const struct head_stats *const stats){
+  struct head_stats *const total = &head->total;
+
+  fputs(head->stats_nfiles > 0 ? ",\n{\"name\":" : "\n{\"name\":",
+        head->stats_fp);
+  head_stats_string(head->stats_fp, name);
+  putc(',', head->stats_fp);
+  head_stats_fields(head->stats_fp, stats);
+  putc('}', head->stats_fp);
+  head->stats_nfiles += 1;
+  total->bytes_read += stats->bytes_read;
+  total->bytes_written += stats->bytes_written;
+  total->lines += stats->lines;
+  total->nread += stats->nread;
+  total->nwrite += stats->nwrite;
+  total->engines |= stats->engines;
+  total->lines_known = total->lines_known && stats->lines_known;
+}
+
+/**
+ * Stop the (--stats) clocks after a file and report its counters.
+ *
+ * The lines written follow from @ref head::remain. Output collected by a
+ * worker in @ref head::obuf gets reported once written to STDOUT instead.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     name File name.
+ */
+static void
+head_stats_end(struct head *const head,
+               const char *const name){
+  struct head_stats *const stats = &head->stats;
+
+  if(head->stats_fp){
+    stats->wall = head_clock(CLOCK_MONOTONIC) - stats->wall;
+    stats->cpu = head_clock(CLOCK_THREAD_CPUTIME_ID) - stats->cpu;
+    if(head->bytes || head->elide){
+      stats->lines_known = false;
+    }
+    else{
+      stats->lines = head->nlines - head->remain;
+    }
+    if(head->obuf == NULL){
+      head_stats_report(head, name, stats);
+    }
+  }
+}
+
+/**
+ * Start the (--stats) report.
+ *
+ * Corresponds to the (--stats) argument.
+ *
+ * File descriptors 1 and 2 stand for @ref head::out and @ref head::err.
+ * When serving a request, no other file descriptor is allowed.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     s    File descriptor receiving the report.
+ */
+static void
+head_stats_open(struct head *const head,
+                const char *const s){
+  long fd;
+  char *ep;
+  int dupfd;
+
+  fd = strtol(s, &ep, 10);
+  if(fd == STDOUT_FILENO){
+    fd = head->out;
+  }
+  else if(fd == STDERR_FILENO){
+    fd = head->err;
+  }
+  else if(head->cache){
+    fd = -1;
+  }
+  if(s[0] < '0' || s[0] > '9' || *ep != '\0' || fd < 0 || fd > INT_MAX){
+    head_warn(head, false, "invalid file descriptor: %s", s);
+    return;
+  }
+  dupfd = dup((int)fd);
+  if(dupfd < 0){
+    head_warn(head, true, "stats: %s", s);
+    return;
+  }
+  head->stats_fp = fdopen(dupfd, "w");
+  if(head->stats_fp == NULL){
+    head_warn(head, true, "stats: %s", s);
+    close(dupfd);
+    return;
+  }
+  memset(&head->total, 0, sizeof(head->total));
+  head->total.lines_known = true;
+  head->total.wall = head_clock(CLOCK_MONOTONIC);
+  head->total.cpu = head_clock(CLOCK_PROCESS_CPUTIME_ID);
+  fputs("{\"files\":[", head->stats_fp);
+}
+
+/**
+ * Finish the (--stats) report with the totals of the whole run.
+ *
+ * @param[in,out] head See @ref head.
+ */
+static void
+head_stats_close(struct head *const head){
+  struct head_stats *const total = &head->total;
+
+  total->wall = head_clock(CLOCK_MONOTONIC) - total->wall;
+  total->cpu = head_clock(CLOCK_PROCESS_CPUTIME_ID) - total->cpu;
+  fputs("\n],\n\"total\":{", head->stats_fp);
+  head_stats_fields(head->stats_fp, total);
+  fputs("}}\n", head->stats_fp);
+  if(fclose(head->stats_fp) != 0){
+    head_warn(head, true, "stats");
+  }
+  head->stats_fp = NULL;
+}
+
+/**
+ * Append bytes to a growing output buffer.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in,out] obuf Output buffer.
+ * @param[in]     buf  Bytes to append.
+ * @param[in]     len  Number of bytes in @p buf.
+ * @retval        0    Successfully appended all bytes.
+ * @retval        -1   Failed to grow @p obuf.
+ */
+static int
+head_append(struct head *const head,
+            struct head_obuf *const obuf,
+            const char *const buf,
+            const size_t len){
+  void *mem;
+  size_t size;
+
+  if(len == 0){
+    return 0;
+  }
+  if(obuf->size - obuf->len < len){
+    size = obuf->size * 2;
+    if(size - obuf->len < len){
+      size = obuf->len + len;
+    }
+    mem = realloc(obuf->data, size);
+    if(mem == NULL){
+      head_warn(head, true, "realloc");
+      return -1;
+    }
+    obuf->data = mem;
+    obuf->size = size;
+  }
+  memcpy(obuf->data + obuf->len, buf, len);
+  obuf->len += len;
+  return 0;
+}
+
+/**
+ * Write all bytes in a buffer to STDOUT.
+ *
+ * A pending file banner in @ref head::hdr gets written in front of the
+ * bytes with the same writev() call. Retries on short writes and on EINTR.
+ * If @ref head::obuf set, the bytes get appended to that buffer instead,
+ * or passed to @ref head::sink if set.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     buf  Bytes to write.
+ * @param[in]     len  Number of bytes in @p buf, or 0 to only write the
+ *                     pending banner.
+ * @retval        0    Successfully wrote all bytes.
+ * @retval        -1   Failed to write to STDOUT.
+ */
+static int
+head_write(struct head *const head,
+           const char *buf,
+           size_t len){
+  struct iovec iov[2];
+  struct iovec *iovp;
+  int iovcnt;
+  ssize_t nwrite;
+
+  if(head->obuf){
+    return head_append(head, head->obuf, buf, len);
+  }
+  if(head->sink){
+    if((head->hdr.len > 0 &&
+        head->sink(head->sink_arg, head->hdr.data, head->hdr.len) != 0) ||
+       (len > 0 && head->sink(head->sink_arg, buf, len) != 0)){
+      head->hdr.len = 0;
+      head_warn(head, true, "write");
+      return -1;
+    }
+    head->hdr.len = 0;
+    return 0;
+  }
+  iovcnt = 0;
+  if(head->hdr.len > 0){
+    iov[iovcnt].iov_base = head->hdr.data;
+    iov[iovcnt].iov_len = head->hdr.len;
+    iovcnt += 1;
+    head->hdr.len = 0;
+  }
+  if(len > 0){
+    iov[iovcnt].iov_base = (void *)(uintptr_t)buf;
+    iov[iovcnt].iov_len = len;
+    iovcnt += 1;
+  }
+  iovp = iov;
+  while(iovcnt > 0){
+    nwrite = writev(head->out, iovp, iovcnt);
+    if(nwrite < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      head_warn(head, true, "write");
+      return -1;
+    }
+    head->stats.nwrite += 1;
+    head->stats.bytes_written += (uintmax_t)nwrite;
+    HEAD_PROBE1(write, nwrite);
+    while(iovcnt > 0 && (size_t)nwrite >= iovp->iov_len){
+      nwrite -= (ssize_t)iovp->iov_len;
+      iovp += 1;
+      iovcnt -= 1;
+    }
+    if(iovcnt > 0){
+      iovp->iov_base = (char *)iovp->iov_base + nwrite;
+      iovp->iov_len -= (size_t)nwrite;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Write a pending file banner not followed by any bytes of the file.
+ *
+ * @param[in,out] head See @ref head.
+ */
+static void
+head_flush(struct head *const head){
+  if(head->hdr.len > 0){
+    head_write(head, NULL, 0);
+  }
+}
+
+/**
+ * Find the end of the first records in a buffer.
+ *
+ * Portable kernel used when the CPU does not support a vectorized version,
+ * and to scan the bytes left over at the end of a vectorized scan.
+ *
+ * @param[in]     buf    Buffer to search.
+ * @param[in]     len    Number of bytes in @p buf.
+ * @param[in]     delim  Record delimiter.
+ * @param[in,out] nlines Number of records still wanted. Gets decremented by
+ *                       the number of complete records found in @p buf.
+ * @return               Number of bytes in @p buf up to and including the
+ *                       last delimiter wanted, or @p len if @p buf does not
+ *                       contain enough records.
+ */
+LINKAGE size_t
+head_scan_scalar(const char *const buf,
+                 const size_t len,
+                 const int delim,
+                 uintmax_t *const nlines){
+  const char *p;
+  const char *ep;
+
+  p = buf;
+  ep = buf + len;
+  while(*nlines > 0 && p < ep){
+    p = memchr(p, delim, (size_t)(ep - p));
+    if(p == NULL){
+      return len;
+    }
+    p += 1;
+    *nlines -= 1;
+  }
+  return (size_t)(p - buf);
+}
+
+#ifdef HEAD_SCAN_X86
+/**
+ * Get the position of a set bit in a match mask.
+ *
+ * @param[in] mask Bit mask with at least @p n bits set.
+ * @param[in] n    Select the n-th set bit, counting from 1.
+ * @return         Index of the selected bit.
+ */
+static size_t
+head_scan_mask_nth(unsigned int mask,
+                   uintmax_t n){
+  while(n > 1){
+    mask &= mask - 1;
+    n -= 1;
+  }
+  return (size_t)__builtin_ctz(mask);
+}
+
+/**
+ * SSE2 version of @ref head_scan_scalar.
+ *
+ * Compares 32 bytes per iteration and counts the matches with a popcount
+ * of the comparison mask, only locating individual delimiters in the
+ * block that contains the last one wanted.
+ *
+ * @param[in]     buf    See @ref head_scan_scalar.
+ * @param[in]     len    See @ref head_scan_scalar.
+ * @param[in]     delim  See @ref head_scan_scalar.
+ * @param[in,out] nlines See @ref head_scan_scalar.
+ * @return               See @ref head_scan_scalar.
+ */
+__attribute__((target("sse2")))
+LINKAGE size_t
+head_scan_sse2(const char *const buf,
+               const size_t len,
+               const int delim,
+               uintmax_t *const nlines){
+  __m128i needle;
+  __m128i v0;
+  __m128i v1;
+  unsigned int mask;
+  unsigned int count;
+  size_t i;
+
+  needle = _mm_set1_epi8((char)delim);
+  for(i = 0; *nlines > 0 && len - i >= 32; i += 32){
+    v0 = _mm_loadu_si128((const __m128i *)(const void *)(buf + i));
+    v1 = _mm_loadu_si128((const __m128i *)(const void *)(buf + i + 16));
+    mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v0, needle)) |
+           (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v1, needle)) << 16;
+    count = (unsigned int)__builtin_popcount(mask);
+    if(count >= *nlines){
+      i += head_scan_mask_nth(mask, *nlines) + 1;
+      *nlines = 0;
+      return i;
+    }
+    *nlines -= count;
+  }
+  return i + head_scan_scalar(buf + i, len - i, delim, nlines);
+}
+
+/**
+ * AVX2 version of @ref head_scan_scalar.
+ *
+ * Same approach as @ref head_scan_sse2 using 64 bytes per iteration.
+ *
+ * @param[in]     buf    See @ref head_scan_scalar.
+ * @param[in]     len    See @ref head_scan_scalar.
+ * @param[in]     delim  See @ref head_scan_scalar.
+ * @param[in,out] nlines See @ref head_scan_scalar.
+ * @return               See @ref head_scan_scalar.
+ */
+__attribute__((target("avx2")))
+LINKAGE size_t
+head_scan_avx2(const char *const buf,
+               const size_t len,
+               const int delim,
+               uintmax_t *const nlines){
+  __m256i needle;
+  __m256i v0;
+  __m256i v1;
+  unsigned int mask0;
+  unsigned int mask1;
+  unsigned int count0;
+  unsigned int count1;
+  size_t i;
+
+  needle = _mm256_set1_epi8((char)delim);
+  for(i = 0; *nlines > 0 && len - i >= 64; i += 64){
+    v0 = _mm256_loadu_si256((const __m256i *)(const void *)(buf + i));
+    v1 = _mm256_loadu_si256((const __m256i *)(const void *)(buf + i + 32));
+    mask0 = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v0, needle));
+    mask1 = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v1, needle));
+    count0 = (unsigned int)__builtin_popcount(mask0);
+    count1 = (unsigned int)__builtin_popcount(mask1);
+    if(count0 + count1 >= *nlines){
+      if(count0 >= *nlines){
+        i += head_scan_mask_nth(mask0, *nlines) + 1;
+      }
+      else{
+        i += 32 + head_scan_mask_nth(mask1, *nlines - count0) + 1;
+      }
+      *nlines = 0;
+      return i;
+    }
+    *nlines -= count0 + count1;
+  }
+  return i + head_scan_sse2(buf + i, len - i, delim, nlines);
+}
+#endif /* HEAD_SCAN_X86 */
+
+/**
+ * Delimiter scanning kernel selected by @ref head_scan_init.
+ *
+ * See @ref head_scan_scalar for the interface.
+ */
+static size_t
+(*head_scan)(const char *const buf,
+             const size_t len,
+             const int delim,
+             uintmax_t *const nlines) = head_scan_scalar;
+
+/**
+ * Select the fastest delimiter scanning kernel supported by the CPU.
+ */
+static void
+head_scan_init(void){
+#ifdef HEAD_SCAN_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")){
+    head_scan = head_scan_avx2;
+  }
+  else if(__builtin_cpu_supports("sse2")){
+    head_scan = head_scan_sse2;
+  }
+#endif /* HEAD_SCAN_X86 */
+}
+
+/**
+ * Find the start of the last records in a buffer.
+ *
+ * @param[in]     buf    Buffer to search backwards.
+ * @param[in]     len    Number of bytes in @p buf.
+ * @param[in]     delim  Record delimiter.
+ * @param[in,out] nlines Number of delimiters still wanted, counting from the
+ *                       end of @p buf. Gets decremented by the number of
+ *                       delimiters found.
+ * @return               Number of bytes in @p buf up to and including the
+ *                       last delimiter wanted, or 0 if @p buf does not
+ *                       contain enough delimiters.
+ */
+LINKAGE size_t
+head_rscan(const char *const buf,
+           const size_t len,
+           const int delim,
+           uintmax_t *const nlines){
+  const char *p;
+  size_t end;
+
+  end = len;
+  while(*nlines > 0){
+    p = memrchr(buf, delim, end);
+    if(p == NULL){
+      return 0;
+    }
+    end = (size_t)(p - buf);
+    *nlines -= 1;
+  }
+  return end == len ? len : end + 1;
+}
+
+/**
+ * Take the bytes at the start of a block that belong to the wanted lines
+ * or bytes.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     buf  Block of input bytes.
+ * @param[in]     len  Number of bytes in @p buf.
+ * @return             Number of bytes to print from the start of @p buf.
+ */
+static size_t
+head_take(struct head *const head,
+          const char *const buf,
+          size_t len){
+  if(head->bytes){
+    if(head->remain < len){
+      len = (size_t)head->remain;
+    }
+    head->remain -= len;
+  }
+  else{
+    len = head_scan(buf, len, head->delim, &head->remain);
+  }
+  return len;
+}
+
+/**
+ * Print head lines from a file descriptor.
+ *
+ * Reads large blocks and writes the prefix of each block that belongs to
+ * the first lines with a single write, so the number of system calls
+ * depends on the number of bytes rather than the number of lines. Lines
+ * longer than a block get forwarded one block at a time, so memory use
+ * stays at @ref HEAD_BLOCK_SIZE no matter how long the lines are.
+ *
+ * Writes at most @ref head::remain lines or bytes, starting at the current
+ * file offset of @p fd. In byte mode, the reads never go past the last byte
+ * wanted. In line mode, the bytes read past the last line get handed back
+ * to a seekable STDIN, leaving its offset right after the printed lines
+ * for the next process sharing it.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor to read from.
+ * @param[in]     name File name used in error messages.
+ * @retval        0    Printed the lines or bytes, or reached end of file.
+ * @retval        -1   Error occurred.
+ */
+static int
+head_fd(struct head *const head,
+        const int fd,
+        const char *const name){
+  ssize_t nread;
+  size_t count;
+  size_t len;
+
+  if(head->buf == NULL){
+    head->buf = malloc(HEAD_BLOCK_SIZE);
+    if(head->buf == NULL){
+      head_warn(head, true, "malloc");
+      return -1;
+    }
+  }
+  head_engine(head, HEAD_ENGINE_READ);
+  while(head->remain > 0){
+    count = HEAD_BLOCK_SIZE;
+    if(head->bytes && head->remain < count){
+      count = (size_t)head->remain;
+    }
+    nread = read(fd, head->buf, count);
+    if(nread < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      head_warn(head, true, "read: %s", name);
+      return -1;
+    }
+    if(nread == 0){
+      break;
+    }
+    head->stats.nread += 1;
+    head->stats.bytes_read += (uintmax_t)nread;
+    HEAD_PROBE2(read, fd, nread);
+    len = head_take(head, head->buf, (size_t)nread);
+    if(head_write(head, head->buf, len) < 0){
+      return -1;
+    }
+    if(fd == head->in && len < (size_t)nread &&
+       lseek(fd, (off_t)len - nread, SEEK_CUR) < 0 && errno != ESPIPE){
+      head_warn(head, true, "lseek: %s", name);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+#ifdef HEAD_ZLIB
+/**
+ * Decompression state of a gzip file, see @ref head_gz_read.
+ */
+struct head_gz{
+  /**
+   * zlib stream state.
+   */
+  z_stream zs;
+
+  /**
+   * Buffer of compressed bytes with @ref HEAD_BLOCK_SIZE bytes.
+   */
+  unsigned char *in;
+
+  /**
+   * File name used in error messages.
+   */
+  const char *name;
+
+  /**
+   * File descriptor to read compressed data from.
+   */
+  int fd;
+
+  /**
+   * Set once the current gzip member has ended.
+   */
+  bool end;
+
+  /**
+   * Padding for alignment.
+   */
+  char pad[3];
+};
+#else
+struct head_gz;
+#endif /* HEAD_ZLIB */
+
+#ifdef HEAD_ZLIB
+/**
+ * Start decompressing a gzip file.
+ *
+ * Compressed data gets read from the current file offset of @p fd, after
+ * the bytes already read into @p pre.
+ *
+ * @param[in,out] head   See @ref head.
+ * @param[out]    gz     See @ref head_gz.
+ * @param[in]     fd     File descriptor to read compressed data from.
+ * @param[in]     pre    Compressed bytes already read from @p fd.
+ * @param[in]     prelen Number of bytes in @p pre, at most
+ *                       @ref HEAD_BLOCK_SIZE.
+ * @param[in]     name   File name used in error messages.
+ * @retval        0      Ready to decompress.
+ * @retval        -1     Error occurred.
+ */
+static int
+head_gz_open(struct head *const head,
+             struct head_gz *const gz,
+             const int fd,
+             const char *const pre,
+             const size_t prelen,
+             const char *const name){
+  memset(gz, 0, sizeof(*gz));
+  gz->in = malloc(HEAD_BLOCK_SIZE);
+  if(gz->in == NULL){
+    head_warn(head, true, "malloc");
+    return -1;
+  }
+  if(inflateInit2(&gz->zs, 15 + 16) != Z_OK){
+    head_warn(head, false, "%s: inflateInit2 failed", name);
+    free(gz->in);
+    return -1;
+  }
+  memcpy(gz->in, pre, prelen);
+  gz->zs.next_in = gz->in;
+  gz->zs.avail_in = (uInt)prelen;
+  gz->name = name;
+  gz->fd = fd;
+  head_engine(head, HEAD_ENGINE_GZIP);
+  return 0;
+}
+
+/**
+ * Decompress the next bytes of a gzip file.
+ *
+ * Concatenated gzip members get decompressed one after another, like
+ * gzip -d does.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in,out] gz   See @ref head_gz.
+ * @param[out]    buf  Buffer receiving the decompressed bytes.
+ * @param[in]     len  Size of @p buf.
+ * @retval        >0   Number of bytes decompressed into @p buf.
+ * @retval        0    End of the compressed data.
+ * @retval        -1   Error occurred.
+ */
+static ssize_t
+head_gz_read(struct head *const head,
+             struct head_gz *const gz,
+             char *const buf,
+             const size_t len){
+  ssize_t nread;
+  int rc;
+
+  for(;;){
+    if(gz->zs.avail_in == 0){
+      nread = read(gz->fd, gz->in, HEAD_BLOCK_SIZE);
+      if(nread < 0){
+        if(errno == EINTR){
+          continue;
+        }
+        head_warn(head, true, "read: %s", gz->name);
+        return -1;
+      }
+      if(nread == 0){
+        if(!gz->end){
+          head_warn(head, false, "%s: unexpected end of file", gz->name);
+          return -1;
+        }
+        return 0;
+      }
+      head->stats.nread += 1;
+      head->stats.bytes_read += (uintmax_t)nread;
+      HEAD_PROBE2(read, gz->fd, nread);
+      gz->zs.next_in = gz->in;
+      gz->zs.avail_in = (uInt)nread;
+    }
+    if(gz->end){
+      inflateReset(&gz->zs);
+      gz->end = false;
+    }
+    gz->zs.next_out = (unsigned char *)buf;
+    gz->zs.avail_out = (uInt)len;
+    rc = inflate(&gz->zs, Z_NO_FLUSH);
+    if(rc == Z_STREAM_END){
+      gz->end = true;
+    }
+    else if(rc != Z_OK && rc != Z_BUF_ERROR){
+      head_warn(head,
+                false,
+                "%s: %s",
+                gz->name,
+                gz->zs.msg ? gz->zs.msg : "invalid compressed data");
+      return -1;
+    }
+    if(gz->zs.avail_out < len){
+      return (ssize_t)(len - gz->zs.avail_out);
+    }
+  }
+}
+
+/**
+ * Stop decompressing a gzip file started by @ref head_gz_open.
+ *
+ * @param[in,out] gz See @ref head_gz.
+ */
+static void
+head_gz_close(struct head_gz *const gz){
+  inflateEnd(&gz->zs);
+  free(gz->in);
+}
+#endif /* HEAD_ZLIB */
+
+/**
+ * Ring of the stream offsets where the most recent lines end.
+ */
+struct head_ring{
+  /**
+   * Line end offsets, starting at @ref first and wrapping around.
+   */
+  uintmax_t *off;
+
+  /**
+   * Number of offsets allocated in @ref off.
+   */
+  size_t size;
+
+  /**
+   * Index of the oldest offset in @ref off.
+   */
+  size_t first;
+
+  /**
+   * Number of offsets stored in @ref off.
+   */
+  size_t len;
+};
+
+/**
+ * Add the end offset of a new line to the ring of recent lines.
+ *
+ * Once the ring holds @ref head::remain lines, the oldest line gets pushed
+ * out and may get written.
+ *
+ * @param[in,out] head    See @ref head.
+ * @param[in,out] ring    See @ref head_ring.
+ * @param[in]     off     Stream offset after the newline.
+ * @param[out]    release Set to the end offset of the line pushed out.
+ * @retval        0       Added the line.
+ * @retval        -1      Failed to grow the ring.
+ */
+static int
+head_ring_push(struct head *const head,
+               struct head_ring *const ring,
+               const uintmax_t off,
+               uintmax_t *const release){
+  void *mem;
+  size_t size;
+
+  if(ring->len == head->remain){
+    *release = ring->off[ring->first];
+    ring->first = (ring->first + 1) % ring->size;
+    ring->len -= 1;
+  }
+  if(ring->len == ring->size){
+    size = ring->size * 2 + 16;
+    mem = realloc(ring->off, size * sizeof(*ring->off));
+    if(mem == NULL){
+      head_warn(head, true, "realloc");
+      return -1;
+    }
+    ring->off = mem;
+    memcpy(&ring->off[ring->size],
+           ring->off,
+           ring->first * sizeof(*ring->off));
+    ring->size = size;
+  }
+  ring->off[(ring->first + ring->len) % ring->size] = off;
+  ring->len += 1;
+  return 0;
+}
+
+/**
+ * Print all but the last lines or bytes from a file descriptor.
+ *
+ * Holds back the data of the last lines in a buffer along with a
+ * @ref head_ring of the offsets where those lines end. A line gets written
+ * as soon as enough newer lines have been read to push it out of the ring,
+ * so memory use depends on the size of the last lines rather than the whole
+ * input. In byte mode only the last bytes get held back.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor to read from.
+ * @param[in,out] gz   Decompress the data read from @p fd, or NULL to
+ *                     print it as is. See @ref head_gz.
+ * @param[in]     name File name used in error messages.
+ */
+static void
+head_elide_fd(struct head *const head,
+              const int fd,
+              struct head_gz *const gz,
+              const char *const name){
+  struct head_ring ring;
+  char *pend;
+  const char *p;
+  const char *ep;
+  void *mem;
+  uintmax_t pbase;
+  uintmax_t release;
+  size_t pend_size;
+  size_t pstart;
+  size_t plen;
+  size_t len;
+  ssize_t nread;
+  int rc;
+
+  memset(&ring, 0, sizeof(ring));
+  pend = NULL;
+  pbase = 0;
+  release = 0;
+  pend_size = 0;
+  pstart = 0;
+  plen = 0;
+  rc = 0;
+  if(gz == NULL){
+    head_engine(head, HEAD_ENGINE_READ);
+  }
+  do{
+    if(pend_size - plen < HEAD_BLOCK_SIZE){
+      if(pstart > 0){
+        memmove(pend, pend + pstart, plen - pstart);
+        pbase += pstart;
+        plen -= pstart;
+        pstart = 0;
+      }
+      if(plen > pend_size / 2 || pend_size - plen < HEAD_BLOCK_SIZE){
+        mem = realloc(pend, pend_size * 2 + HEAD_BLOCK_SIZE);
+        if(mem == NULL){
+          head_warn(head, true, "realloc");
+          break;
+        }
+        pend = mem;
+        pend_size = pend_size * 2 + HEAD_BLOCK_SIZE;
+      }
+    }
+#ifdef HEAD_ZLIB
+    if(gz){
+      nread = head_gz_read(head, gz, pend + plen, HEAD_BLOCK_SIZE);
+      if(nread < 0){
+        break;
+      }
+    }
+    else
+#endif /* HEAD_ZLIB */
+    {
+      nread = read(fd, pend + plen, HEAD_BLOCK_SIZE);
+      if(nread < 0){
+        if(errno == EINTR){
+          continue;
+        }
+        head_warn(head, true, "read: %s", name);
+        break;
+      }
+      head->stats.nread += 1;
+      head->stats.bytes_read += (uintmax_t)nread;
+      HEAD_PROBE2(read, fd, nread);
+    }
+    p = pend + plen;
+    ep = p + nread;
+    plen += (size_t)nread;
+    if(head->bytes){
+      if(pbase + plen > head->remain){
+        release = pbase + plen - head->remain;
+      }
+    }
+    else{
+      while(rc == 0 &&
+            (p = memchr(p, head->delim, (size_t)(ep - p))) != NULL){
+        p += 1;
+        rc = head_ring_push(head, &ring, pbase + (size_t)(p - pend), &release);
+      }
+      /*
+       * The last line counts even without a newline at the end of the file.
+       */
+      if(nread == 0 && ring.len > 0 && ring.len == head->remain &&
+         ring.off[(ring.first + ring.len - 1) % ring.size] < pbase + plen){
+        release = ring.off[ring.first];
+      }
+    }
+    len = (size_t)(release - pbase) - pstart;
+    if(rc < 0 || head_write(head, pend + pstart, len) < 0){
+      break;
+    }
+    pstart += len;
+  } while(nread != 0);
+  free(ring.off);
+  free(pend);
+}
+
+#ifdef HEAD_ZLIB
+/**
+ * Check if a file starts with the gzip magic bytes.
+ *
+ * @param[in] buf First bytes of the file.
+ * @param[in] len Number of bytes in @p buf.
+ * @retval    true  File is gzip compressed.
+ * @retval    false File is not gzip compressed.
+ */
+static bool
+head_gz_magic(const char *const buf,
+              const size_t len){
+  return len >= 2 && buf[0] == '\x1f' && buf[1] == '\x8b';
+}
+
+/**
+ * Print head lines or bytes of the data decompressed from a gzip file.
+ *
+ * The decompressed blocks get handled like blocks read by @ref head_fd,
+ * and decompression stops as soon as the wanted lines or bytes have been
+ * printed. When printing all but the last lines or bytes, the decompressed
+ * data goes through @ref head_elide_fd instead.
+ *
+ * @param[in,out] head   See @ref head.
+ * @param[in]     fd     File descriptor to read compressed data from.
+ * @param[in]     pre    Compressed bytes already read from @p fd.
+ * @param[in]     prelen Number of bytes in @p pre, at most
+ *                       @ref HEAD_BLOCK_SIZE.
+ * @param[in]     name   File name used in error messages.
+ */
+static void
+head_gz(struct head *const head,
+        const int fd,
+        const char *const pre,
+        const size_t prelen,
+        const char *const name){
+  struct head_gz gz;
+  ssize_t nread;
+  size_t len;
+
+  if(!head->elide && head->buf == NULL){
+    head->buf = malloc(HEAD_BLOCK_SIZE);
+    if(head->buf == NULL){
+      head_warn(head, true, "malloc");
+      return;
+    }
+  }
+  if(head_gz_open(head, &gz, fd, pre, prelen, name) < 0){
+    return;
+  }
+  if(head->elide){
+    head_elide_fd(head, fd, &gz, name);
+  }
+  else{
+    while(head->remain > 0){
+      nread = head_gz_read(head, &gz, head->buf, HEAD_BLOCK_SIZE);
+      if(nread <= 0){
+        break;
+      }
+      len = head_take(head, head->buf, (size_t)nread);
+      if(head_write(head, head->buf, len) < 0){
+        break;
+      }
+    }
+  }
+  head_gz_close(&gz);
+}
+#endif /* HEAD_ZLIB */
+
+/**
+ * Print head lines or bytes from a file descriptor that is not a regular
+ * file, or from STDIN.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor to read from.
+ * @param[in]     name File name used in error messages.
+ */
+static void
+head_stream(struct head *const head,
+            const int fd,
+            const char *const name){
+  if(head->elide){
+    head_elide_fd(head, fd, NULL, name);
+  }
+  else{
+    head_fd(head, fd, name);
+  }
+}
+
+/**
+ * Select the kernel copy method based on the file type of STDOUT.
+ *
+ * @param[in,out] head See @ref head.
+ */
+static void
+head_copy_init(struct head *const head){
+  struct stat sb;
+
+  head->copy = HEAD_COPY_NONE;
+  if(fstat(head->out, &sb) == 0){
+    if(S_ISREG(sb.st_mode)){
+      head->copy = HEAD_COPY_FILE_RANGE;
+    }
+    else if(S_ISFIFO(sb.st_mode)){
+      head->copy = HEAD_COPY_SPLICE;
+    }
+    else{
+      head->copy = HEAD_COPY_SENDFILE;
+    }
+  }
+}
+
+/**
+ * Copy a byte range of a file to STDOUT without passing it through user
+ * space.
+ *
+ * If the kernel refuses the copy for this pair of files, kernel copies get
+ * disabled in @p head and the caller has to write the bytes not copied.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor of a regular file.
+ * @param[in,out] off  Offset of the first byte to copy. Gets advanced past
+ *                     the bytes copied.
+ * @param[in]     end  Offset after the last byte to copy.
+ * @param[in]     name File name used in error messages.
+ * @retval        0    Copied the range, or the file ended before @p end.
+ * @retval        1    Kernel copy not supported, starting at @p off.
+ * @retval        -1   Failed to copy the range.
+ */
+static int
+head_copy(struct head *const head,
+          const int fd,
+          off_t *const off,
+          const off_t end,
+          const char *const name){
+  enum head_engine engine;
+  loff_t loff;
+  size_t count;
+  ssize_t ncopy;
+
+  if(head->hdr.len > 0 && head->copy != HEAD_COPY_NONE){
+    if(end - *off <= HEAD_COALESCE_MAX){
+      return 1;
+    }
+    if(head_write(head, NULL, 0) < 0){
+      return -1;
+    }
+  }
+  while(*off < end){
+    count = HEAD_COPY_CHUNK;
+    if(end - *off < (off_t)count){
+      count = (size_t)(end - *off);
+    }
+    loff = *off;
+    switch(head->copy){
+      case HEAD_COPY_FILE_RANGE:
+        engine = HEAD_ENGINE_COPY_FILE_RANGE;
+        ncopy = copy_file_range(fd, &loff, head->out, NULL, count, 0);
+        break;
+      case HEAD_COPY_SPLICE:
+        engine = HEAD_ENGINE_SPLICE;
+        ncopy = splice(fd, &loff, head->out, NULL, count, SPLICE_F_MORE);
+        break;
+      case HEAD_COPY_SENDFILE:
+        engine = HEAD_ENGINE_SENDFILE;
+        ncopy = sendfile(head->out, fd, off, count);
+        loff = *off;
+        break;
+      case HEAD_COPY_NONE:
+      default:
+        return 1;
+    }
+    if(ncopy < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      if(errno == EINVAL || errno == EXDEV || errno == ENOSYS ||
+         errno == EOPNOTSUPP || errno == EBADF){
+        head->copy = HEAD_COPY_NONE;
+        return 1;
+      }
+      head_warn(head, true, "copy: %s", name);
+      return -1;
+    }
+    if(ncopy == 0){
+      break;
+    }
+    head_engine(head, engine);
+    head->stats.nwrite += 1;
+    head->stats.bytes_read += (uintmax_t)ncopy;
+    head->stats.bytes_written += (uintmax_t)ncopy;
+    HEAD_PROBE2(copy, head_engine_names[engine], ncopy);
+    *off = loff;
+  }
+  return 0;
+}
+
+/**
+ * Find the hole or data extent of a sparse file starting at an offset.
+ *
+ * Files not marked @ref head::sparse, or on file systems that cannot tell,
+ * consist of a single data extent. Moves the file offset of @p fd.
+ *
+ * @param[in]  head See @ref head.
+ * @param[in]  fd   File descriptor of a regular file.
+ * @param[in]  off  Offset of the extent.
+ * @param[in]  size Offset to stop at, at most the file size.
+ * @param[out] end  Offset after the extent, at most @p size.
+ * @retval     true  The extent is a hole.
+ * @retval     false The extent holds data.
+ */
+static bool
+head_extent(const struct head *const head,
+            const int fd,
+            const off_t off,
+            const off_t size,
+            off_t *const end){
+  off_t next;
+
+  *end = size;
+  if(!head->sparse){
+    return false;
+  }
+  next = lseek(fd, off, SEEK_DATA);
+  if(next < 0){
+    return errno == ENXIO;
+  }
+  if(next > off){
+    if(next < size){
+      *end = next;
+    }
+    return true;
+  }
+  next = lseek(fd, off, SEEK_HOLE);
+  if(next > off && next < size){
+    *end = next;
+  }
+  return false;
+}
+
+/**
+ * Print a hole of a sparse file.
+ *
+ * A hole reads back as zero bytes. It gets copied by copy_file_range(),
+ * which lets the file system handle it, and otherwise written as zeros
+ * from the block buffer, so the hole never gets read into the page cache
+ * or mapped.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor of a regular file.
+ * @param[in]     off  Offset of the hole.
+ * @param[in]     end  Offset after the hole.
+ * @param[in]     name File name used in error messages.
+ * @retval        0    Printed the hole.
+ * @retval        -1   Error occurred.
+ */
+static int
+head_hole(struct head *const head,
+          const int fd,
+          off_t off,
+          const off_t end,
+          const char *const name){
+  size_t len;
+  int rc;
+
+  head_engine(head, HEAD_ENGINE_HOLE);
+  if(head->copy == HEAD_COPY_FILE_RANGE){
+    rc = head_copy(head, fd, &off, end, name);
+    if(rc <= 0){
+      return rc;
+    }
+  }
+  if(head->buf == NULL){
+    head->buf = malloc(HEAD_BLOCK_SIZE);
+    if(head->buf == NULL){
+      head_warn(head, true, "malloc");
+      return -1;
+    }
+  }
+  memset(head->buf, 0, HEAD_BLOCK_SIZE);
+  for(; off < end; off += (off_t)len){
+    len = HEAD_BLOCK_SIZE;
+    if(end - off < (off_t)len){
+      len = (size_t)(end - off);
+    }
+    if(head_write(head, head->buf, len) < 0){
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Print head lines from a regular file by scanning a memory mapping.
+ *
+ * Maps the file in windows of @ref HEAD_MMAP_WINDOW bytes and scans each
+ * window for the end of the wanted lines. The matching range gets copied
+ * by @ref head_copy, or written straight from the mapping when the kernel
+ * cannot copy it, avoiding the copy into the block buffer. If a window
+ * cannot get mapped, the remaining lines get read by @ref head_fd starting
+ * at that window.
+ *
+ * Every line contains at least one byte, so once @ref head::remain covers
+ * the rest of the file the windows get printed without scanning them. The
+ * same applies in byte mode, where @p end must not exceed the number of
+ * bytes wanted.
+ *
+ * Holes of sparse files get printed by @ref head_hole without mapping
+ * them. A hole contains no line ends, or one line end per byte when lines
+ * end with a NUL byte.
+ *
+ * @param[in,out] head  See @ref head.
+ * @param[in]     fd    File descriptor of a regular file.
+ * @param[in]     start Offset of the first byte to print.
+ * @param[in]     size  Offset to stop printing at, at most the file size.
+ * @param[in]     name  File name used in error messages.
+ * @retval        0     Printed the lines or bytes, or reached @p size.
+ * @retval        -1    Error occurred.
+ */
+static int
+head_mmap(struct head *const head,
+          const int fd,
+          const off_t start,
+          const off_t size,
+          const char *const name){
+  off_t off;
+  off_t end;
+  off_t map_off;
+  off_t copy_off;
+  size_t winlen;
+  size_t skip;
+  size_t len;
+  char *map;
+  int rc;
+
+  off = start;
+  while(head->remain > 0 && off < size){
+    if(head_extent(head, fd, off, size, &end)){
+      if(head->bytes){
+        head->remain -= (uintmax_t)(end - off);
+      }
+      else if(head->delim == '\0'){
+        if(head->remain < (uintmax_t)(end - off)){
+          end = off + (off_t)head->remain;
+        }
+        head->remain -= (uintmax_t)(end - off);
+      }
+      if(head_hole(head, fd, off, end, name) < 0){
+        return -1;
+      }
+      off = end;
+      continue;
+    }
+    map_off = off - off % HEAD_MMAP_WINDOW;
+    winlen = HEAD_MMAP_WINDOW;
+    if(end - map_off < (off_t)winlen){
+      winlen = (size_t)(end - map_off);
+    }
+    map = mmap(NULL, winlen, PROT_READ, MAP_PRIVATE, fd, map_off);
+    if(map == MAP_FAILED){
+      if(lseek(fd, off, SEEK_SET) != off){
+        head_warn(head, true, "lseek: %s", name);
+        return -1;
+      }
+      return head_fd(head, fd, name);
+    }
+    head_engine(head, HEAD_ENGINE_MMAP);
+    skip = (size_t)(off - map_off);
+    if(head->remain >= (uintmax_t)(size - off)){
+      len = winlen - skip;
+      if(head->bytes){
+        head->remain -= len;
+      }
+      else{
+        head->stats.lines_known = false;
+      }
+    }
+    else{
+      madvise(map, winlen, MADV_SEQUENTIAL);
+      len = head_scan(map + skip,
+                      winlen - skip,
+                      head->delim,
+                      &head->remain);
+    }
+    copy_off = off;
+    rc = head_copy(head, fd, &copy_off, off + (off_t)len, name);
+    if(rc > 0){
+      head->stats.bytes_read += len - (size_t)(copy_off - off);
+      rc = head_write(head,
+                      map + (copy_off - map_off),
+                      len - (size_t)(copy_off - off));
+    }
+    if(munmap(map, winlen) != 0){
+      head_warn(head, true, "munmap: %s", name);
+      return -1;
+    }
+    if(rc < 0){
+      return -1;
+    }
+    off = map_off + (off_t)winlen;
+  }
+  return 0;
+}
+
+/**
+ * Print a known byte range of a regular file without scanning it.
+ *
+ * The range gets copied by @ref head_copy if possible, or else by
+ * @ref head_mmap in byte mode.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor of a regular file.
+ * @param[in]     off  Offset of the first byte to print.
+ * @param[in]     end  Offset after the last byte to print.
+ * @param[in]     name File name used in error messages.
+ * @retval        0    Printed the range.
+ * @retval        -1   Error occurred.
+ */
+static int
+head_range(struct head *const head,
+           const int fd,
+           off_t off,
+           const off_t end,
+           const char *const name){
+  bool bytes;
+  int rc;
+
+  rc = head_copy(head, fd, &off, end, name);
+  if(rc > 0){
+    bytes = head->bytes;
+    head->bytes = true;
+    head->remain = (uintmax_t)(end - off);
+    rc = head_mmap(head, fd, off, end, name);
+    head->bytes = bytes;
+  }
+  return rc;
+}
+
+/**
+ * Read a block of a regular file at a given offset.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor of a regular file.
+ * @param[out]    buf  Buffer to store the block.
+ * @param[in]     len  Number of bytes to read.
+ * @param[in]     off  File offset of the block.
+ * @param[in]     name File name used in error messages.
+ * @retval        0    Read all @p len bytes.
+ * @retval        -1   Failed to read the block.
+ */
+static int
+head_pread(struct head *const head,
+           const int fd,
+           char *buf,
+           size_t len,
+           off_t off,
+           const char *const name){
+  ssize_t nread;
+
+  while(len > 0){
+    nread = pread(fd, buf, len, off);
+    if(nread < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      head_warn(head, true, "pread: %s", name);
+      return -1;
+    }
+    if(nread == 0){
+      head_warn(head, false, "%s: file truncated", name);
+      return -1;
+    }
+    head_engine(head, HEAD_ENGINE_PREAD);
+    head->stats.nread += 1;
+    head->stats.bytes_read += (uintmax_t)nread;
+    HEAD_PROBE2(read, fd, nread);
+    buf += nread;
+    len -= (size_t)nread;
+    off += nread;
+  }
+  return 0;
+}
+
+/**
+ * Print all but the last lines or bytes from a regular file.
+ *
+ * Scans backwards from the end of the file, so only the lines getting left
+ * out have to be counted.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor of a regular file.
+ * @param[in]     size Size of the file in bytes.
+ * @param[in]     name File name used in error messages.
+ */
+static void
+head_elide_reg(struct head *const head,
+               const int fd,
+               const off_t size,
+               const char *const name){
+  off_t pos;
+  off_t cut;
+  size_t len;
+  size_t n;
+  bool last;
+
+  cut = 0;
+  if(head->bytes){
+    if(head->remain < (uintmax_t)size){
+      cut = size - (off_t)head->remain;
+    }
+  }
+  else{
+    if(head->buf == NULL){
+      head->buf = malloc(HEAD_BLOCK_SIZE);
+      if(head->buf == NULL){
+        head_warn(head, true, "malloc");
+        return;
+      }
+    }
+    last = true;
+    for(pos = size; pos > 0; last = false){
+      len = HEAD_BLOCK_SIZE;
+      if(pos < (off_t)len){
+        len = (size_t)pos;
+      }
+      pos -= (off_t)len;
+      if(head_pread(head, fd, head->buf, len, pos, name) < 0){
+        return;
+      }
+      /*
+       * The newline ending the last line does not start another line.
+       */
+      if(last && head->buf[len - 1] == head->delim){
+        len -= 1;
+      }
+      n = head_rscan(head->buf, len, head->delim, &head->remain);
+      if(head->remain == 0){
+        cut = pos + (off_t)n;
+        break;
+      }
+    }
+  }
+  head_range(head, fd, 0, cut, name);
+}
+
+/**
+ * Fields at the start of an index file, see @ref head_index.
+ *
+ * Each field takes one uint64_t in native byte order, followed by the
+ * offsets in @ref head_index::off.
+ */
+enum head_index_field{
+  /**
+   * Identifies an index file, set to @ref HEAD_INDEX_MAGIC.
+   */
+  HEAD_INDEX_FIELD_MAGIC,
+
+  /**
+   * Number of lines between offsets, set to @ref HEAD_INDEX_INTERVAL.
+   */
+  HEAD_INDEX_FIELD_INTERVAL,
+
+  /**
+   * Device of the indexed file.
+   */
+  HEAD_INDEX_FIELD_DEV,
+
+  /**
+   * Inode of the indexed file.
+   */
+  HEAD_INDEX_FIELD_INO,
+
+  /**
+   * Size of the indexed file.
+   */
+  HEAD_INDEX_FIELD_SIZE,
+
+  /**
+   * Seconds of the modification time of the indexed file.
+   */
+  HEAD_INDEX_FIELD_MTIME_SEC,
+
+  /**
+   * Nanoseconds of the modification time of the indexed file.
+   */
+  HEAD_INDEX_FIELD_MTIME_NSEC,
+
+  /**
+   * Set if the offsets cover the whole file.
+   */
+  HEAD_INDEX_FIELD_COMPLETE,
+
+  /**
+   * Number of fields.
+   */
+  HEAD_INDEX_NFIELDS
+};
+
+/**
+ * Sparse line offsets of a regular file, cached in the (--index-dir)
+ * directory between runs.
+ */
+struct head_index{
+  /**
+   * Offset after every @ref HEAD_INDEX_INTERVAL lines, so that
+   * off[k] is the offset after line (k + 1) * @ref HEAD_INDEX_INTERVAL.
+   */
+  uint64_t *off;
+
+  /**
+   * Number of offsets in @ref off.
+   */
+  size_t len;
+
+  /**
+   * Number of offsets allocated in @ref off.
+   */
+  size_t size;
+
+  /**
+   * Set if the file does not contain another @ref HEAD_INDEX_INTERVAL
+   * lines after the last offset.
+   */
+  bool complete;
+
+  /**
+   * Padding for alignment.
+   */
+  char pad[7];
+};
+
+/**
+ * Regular file kept open by (--serve), together with its line-offset
+ * index.
+ */
+struct head_cache_entry{
+  /**
+   * Line-offset index of the file, or empty if none got built yet.
+   */
+  struct head_index idx;
+
+  /**
+   * Header identifying the version of the file @ref idx belongs to, see
+   * @ref head_index_key.
+   */
+  uint64_t key[HEAD_INDEX_NFIELDS];
+
+  /**
+   * Device of the file.
+   */
+  dev_t dev;
+
+  /**
+   * Inode of the file.
+   */
+  ino_t ino;
+
+  /**
+   * Value of @ref head_cache::clock when last used.
+   */
+  unsigned long used;
+
+  /**
+   * File descriptor of the file, or -1 if the entry is unused.
+   */
+  int fd;
+
+  /**
+   * Byte ending each line in @ref idx.
+   */
+  char delim;
+
+  /**
+   * Used by a request, so no other request may use or evict it.
+   */
+  bool busy;
+
+  /**
+   * Padding for alignment.
+   */
+  char pad[2];
+};
+
+/**
+ * Regular files kept open between requests by (--serve).
+ *
+ * A request takes an entry for exclusive use while printing the file, so
+ * the file offset and the index need no further locking. Files in use by
+ * another request get opened again.
+ */
+struct head_cache{
+  /**
+   * Protects all members below.
+   */
+  pthread_mutex_t mutex;
+
+  /**
+   * Cached files, replaced in least recently used order.
+   */
+  struct head_cache_entry ent[HEAD_CACHE_SIZE];
+
+  /**
+   * Incremented on each use of an entry.
+   */
+  unsigned long clock;
+};
+
+/**
+ * Fill in the fields identifying the current version of a file.
+ *
+ * @param[in]  sb  File status of the indexed file.
+ * @param[in]  idx See @ref head_index.
+ * @param[out] hdr Index file header, see @ref head_index_field.
+ */
+static void
+head_index_key(const struct stat *const sb,
+               const struct head_index *const idx,
+               uint64_t hdr[HEAD_INDEX_NFIELDS]){
+  hdr[HEAD_INDEX_FIELD_MAGIC] = HEAD_INDEX_MAGIC;
+  hdr[HEAD_INDEX_FIELD_INTERVAL] = HEAD_INDEX_INTERVAL;
+  hdr[HEAD_INDEX_FIELD_DEV] = (uint64_t)sb->st_dev;
+  hdr[HEAD_INDEX_FIELD_INO] = (uint64_t)sb->st_ino;
+  hdr[HEAD_INDEX_FIELD_SIZE] = (uint64_t)sb->st_size;
+  hdr[HEAD_INDEX_FIELD_MTIME_SEC] = (uint64_t)sb->st_mtim.tv_sec;
+  hdr[HEAD_INDEX_FIELD_MTIME_NSEC] = (uint64_t)sb->st_mtim.tv_nsec;
+  hdr[HEAD_INDEX_FIELD_COMPLETE] = idx->complete;
+}
+
+/**
+ * Get the path of the index file for a file.
+ *
+ * Indexes of lines ending with another byte than a newline get the
+ * delimiter added to the name.
+ *
+ * @param[in] head See @ref head.
+ * @param[in] sb   File status of the indexed file.
+ * @param[in] tmp  Append a template suffix for mkstemp().
+ * @return         Allocated path, or NULL if out of memory.
+ */
+static char *
+head_index_path(const struct head *const head,
+                const struct stat *const sb,
+                const bool tmp){
+  char delim[8];
+  char *path;
+  size_t size;
+
+  delim[0] = '\0';
+  if(head->delim != '\n'){
+    sprintf(delim, "-%02x", (unsigned int)(unsigned char)head->delim);
+  }
+  size = strlen(head->index_dir) + 64;
+  path = malloc(size);
+  if(path){
+    sprintf(path,
+            "%s/%lx-%lx%s.idx%s",
+            head->index_dir,
+            (unsigned long)sb->st_dev,
+            (unsigned long)sb->st_ino,
+            delim,
+            tmp ? ".XXXXXX" : "");
+  }
+  return path;
+}
+
+/**
+ * Copy a line-offset index.
+ *
+ * @param[out] dst Copy of @p src, with its own offset array.
+ * @param[in]  src See @ref head_index.
+ * @retval     true  Copied the index.
+ * @retval     false Out of memory, @p dst left unchanged.
+ */
+static bool
+head_index_copy(struct head_index *const dst,
+                const struct head_index *const src){
+  uint64_t *off;
+
+  off = malloc((src->len + 1) * sizeof(*off));
+  if(off == NULL){
+    return false;
+  }
+  memcpy(off, src->off, src->len * sizeof(*off));
+  dst->off = off;
+  dst->len = src->len;
+  dst->size = src->len + 1;
+  dst->complete = src->complete;
+  return true;
+}
+
+/**
+ * Keep a copy of the index of the current file in its (--serve) cache
+ * entry, replacing the copy held before.
+ *
+ * @param[in] head See @ref head.
+ * @param[in] sb   File status of the indexed file.
+ * @param[in] idx  See @ref head_index.
+ */
+static void
+head_index_cache(const struct head *const head,
+                 const struct stat *const sb,
+                 const struct head_index *const idx){
+  struct head_cache_entry *const ent = head->cached;
+  struct head_index copy;
+
+  if(ent && head_index_copy(&copy, idx)){
+    free(ent->idx.off);
+    ent->idx = copy;
+    ent->delim = head->delim;
+    head_index_key(sb, idx, ent->key);
+  }
+}
+
+/**
+ * Check that the offsets of an index read from a file increase strictly
+ * and stay within the indexed file.
+ *
+ * @param[in] off  Offsets read from the index file.
+ * @param[in] len  Number of offsets in @p off.
+ * @param[in] size Size of the indexed file.
+ * @retval    true  The offsets can get used.
+ * @retval    false The index file is corrupt.
+ */
+static bool
+head_index_valid(const uint64_t *const off,
+                 const size_t len,
+                 const off_t size){
+  uint64_t prev;
+  size_t i;
+
+  prev = 0;
+  for(i = 0; i < len; i++){
+    if(off[i] <= prev || off[i] > (uint64_t)size){
+      return false;
+    }
+    prev = off[i];
+  }
+  return true;
+}
+
+/**
+ * Load the index of a file.
+ *
+ * The index kept in the (--serve) cache entry of the file gets used if it
+ * belongs to the current version of the file. Otherwise it gets read from
+ * the (--index-dir) directory. An index file that belongs to another
+ * version of the file, that cannot get parsed, or whose offsets are out of
+ * order or past the end of the file, gets removed. Leaves @p idx empty if
+ * no usable index exists.
+ *
+ * @param[in]  head See @ref head.
+ * @param[in]  sb   File status of the indexed file.
+ * @param[out] idx  See @ref head_index.
+ */
+static void
+head_index_load(const struct head *const head,
+                const struct stat *const sb,
+                struct head_index *const idx){
+  uint64_t key[HEAD_INDEX_NFIELDS];
+  struct head_cache_entry *ent;
+  struct stat isb;
+  uint64_t *data;
+  char *path;
+  size_t size;
+  size_t pos;
+  ssize_t nread;
+  int fd;
+
+  ent = head->cached;
+  if(ent && ent->idx.off && ent->delim == head->delim){
+    head_index_key(sb, idx, key);
+    key[HEAD_INDEX_FIELD_COMPLETE] = ent->key[HEAD_INDEX_FIELD_COMPLETE];
+    if(memcmp(ent->key, key, sizeof(key)) == 0 &&
+       head_index_copy(idx, &ent->idx)){
+      return;
+    }
+  }
+  if(head->index_dir == NULL){
+    return;
+  }
+  path = head_index_path(head, sb, false);
+  if(path == NULL){
+    return;
+  }
+  fd = open(path, O_RDONLY);
+  if(fd < 0){
+    free(path);
+    return;
+  }
+  data = NULL;
+  size = 0;
+  if(fstat(fd, &isb) == 0 &&
+     isb.st_size >= (off_t)sizeof(key) &&
+     isb.st_size % (off_t)sizeof(*data) == 0){
+    size = (size_t)isb.st_size;
+    data = malloc(size);
+  }
+  for(pos = 0; data && pos < size; pos += (size_t)nread){
+    nread = read(fd, (char *)data + pos, size - pos);
+    if(nread <= 0){
+      break;
+    }
+  }
+  close(fd);
+  if(data && pos == size){
+    head_index_key(sb, idx, key);
+    key[HEAD_INDEX_FIELD_COMPLETE] = data[HEAD_INDEX_FIELD_COMPLETE];
+    pos = size / sizeof(*data) - HEAD_INDEX_NFIELDS;
+    if(memcmp(data, key, sizeof(key)) == 0 &&
+       head_index_valid(data + HEAD_INDEX_NFIELDS, pos, sb->st_size)){
+      idx->len = pos;
+      idx->size = idx->len;
+      idx->complete = (data[HEAD_INDEX_FIELD_COMPLETE] != 0);
+      memmove(data, data + HEAD_INDEX_NFIELDS, idx->len * sizeof(*data));
+      idx->off = data;
+      data = NULL;
+      head_index_cache(head, sb, idx);
+    }
+  }
+  if(idx->off == NULL){
+    unlink(path);
+  }
+  free(data);
+  free(path);
+}
+
+/**
+ * Atomically replace the index file of a file, and the index kept in its
+ * (--serve) cache entry.
+ *
+ * @param[in] head See @ref head.
+ * @param[in] sb   File status of the indexed file.
+ * @param[in] idx  See @ref head_index.
+ */
+static void
+head_index_save(const struct head *const head,
+                const struct stat *const sb,
+                const struct head_index *const idx){
+  uint64_t hdr[HEAD_INDEX_NFIELDS];
+  struct iovec iov[2];
+  char *tmp;
+  char *path;
+  size_t len;
+  int fd;
+
+  head_index_cache(head, sb, idx);
+  if(head->index_dir == NULL){
+    return;
+  }
+  path = head_index_path(head, sb, false);
+  tmp = head_index_path(head, sb, true);
+  if(path && tmp){
+    fd = mkstemp(tmp);
+    if(fd >= 0){
+      head_index_key(sb, idx, hdr);
+      iov[0].iov_base = hdr;
+      iov[0].iov_len = sizeof(hdr);
+      iov[1].iov_base = idx->off;
+      iov[1].iov_len = idx->len * sizeof(*idx->off);
+      len = iov[0].iov_len + iov[1].iov_len;
+      if(writev(fd, iov, 2) != (ssize_t)len ||
+         close(fd) != 0 ||
+         rename(tmp, path) != 0){
+        unlink(tmp);
+      }
+    }
+  }
+  free(tmp);
+  free(path);
+}
+
+/**
+ * Extend the index of a file by scanning it from the last offset.
+ *
+ * Holes of sparse files contain no line ends, so they get skipped unless
+ * lines end with a NUL byte.
+ *
+ * @param[in]     head See @ref head.
+ * @param[in]     fd   File descriptor of a regular file.
+ * @param[in]     size Size of the file in bytes.
+ * @param[in,out] idx  See @ref head_index.
+ * @param[in]     want Number of offsets wanted.
+ */
+static void
+head_index_build(const struct head *const head,
+                 const int fd,
+                 const off_t size,
+                 struct head_index *const idx,
+                 const size_t want){
+  off_t off;
+  off_t end;
+  off_t map_off;
+  size_t winlen;
+  size_t pos;
+  uintmax_t need;
+  char *map;
+  void *mem;
+
+  off = 0;
+  if(idx->len > 0){
+    off = (off_t)idx->off[idx->len - 1];
+  }
+  need = HEAD_INDEX_INTERVAL;
+  while(idx->len < want && off < size){
+    end = size;
+    if(head->delim != '\0' && head_extent(head, fd, off, size, &end)){
+      off = end;
+      continue;
+    }
+    map_off = off - off % HEAD_MMAP_WINDOW;
+    winlen = HEAD_MMAP_WINDOW;
+    if(end - map_off < (off_t)winlen){
+      winlen = (size_t)(end - map_off);
+    }
+    map = mmap(NULL, winlen, PROT_READ, MAP_PRIVATE, fd, map_off);
+    if(map == MAP_FAILED){
+      return;
+    }
+    madvise(map, winlen, MADV_SEQUENTIAL);
+    pos = (size_t)(off - map_off);
+    while(idx->len < want && pos < winlen){
+      pos += head_scan(map + pos, winlen - pos, head->delim, &need);
+      if(need > 0){
+        break;
+      }
+      if(idx->len == idx->size){
+        mem = realloc(idx->off, (idx->size * 2 + 64) * sizeof(*idx->off));
+        if(mem == NULL){
+          munmap(map, winlen);
+          return;
+        }
+        idx->off = mem;
+        idx->size = idx->size * 2 + 64;
+      }
+      idx->off[idx->len] = (uint64_t)map_off + pos;
+      idx->len += 1;
+      need = HEAD_INDEX_INTERVAL;
+    }
+    munmap(map, winlen);
+    off = map_off + (off_t)pos;
+  }
+  idx->complete = (off >= size);
+}
+
+/**
+ * Print head lines from a regular file using its line-offset index.
+ *
+ * The index holds the offset after every @ref HEAD_INDEX_INTERVAL lines
+ * and gets extended and saved as needed, so later runs asking for as many
+ * lines skip straight to the offset closest to the end of the wanted lines.
+ * The range before that offset gets printed by @ref head_range without
+ * scanning it, and only the remaining lines get counted by
+ * @ref head_mmap.
+ *
+ * Failing to load or save the index only costs the time to rebuild it,
+ * and does not change the output or the exit status.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor of a regular file.
+ * @param[in]     sb   File status of @p fd.
+ * @param[in]     name File name used in error messages.
+ */
+static void
+head_index(struct head *const head,
+           const int fd,
+           const struct stat *const sb,
+           const char *const name){
+  struct head_index idx;
+  uintmax_t want;
+  uintmax_t remain;
+  size_t len;
+  off_t cut;
+
+  memset(&idx, 0, sizeof(idx));
+  head_engine(head, HEAD_ENGINE_INDEX);
+  head_index_load(head, sb, &idx);
+  want = head->remain / HEAD_INDEX_INTERVAL;
+  if(want > SIZE_MAX){
+    want = SIZE_MAX;
+  }
+  if(idx.len < want && !idx.complete){
+    len = idx.len;
+    head_index_build(head, fd, sb->st_size, &idx, (size_t)want);
+    if(idx.len > len || idx.complete){
+      head_index_save(head, sb, &idx);
+    }
+  }
+  if(idx.len < want){
+    want = idx.len;
+  }
+  cut = 0;
+  if(want > 0){
+    cut = (off_t)idx.off[want - 1];
+    remain = head->remain - want * HEAD_INDEX_INTERVAL;
+    if(head_range(head, fd, 0, cut, name) < 0){
+      remain = 0;
+    }
+    head->remain = remain;
+  }
+  free(idx.off);
+  head_mmap(head, fd, cut, sb->st_size, name);
+}
+
+/**
+ * Chunks of a regular file getting counted by @ref head_pscan.
+ */
+struct head_pscan{
+  /**
+   * Protects all members below.
+   */
+  pthread_mutex_t mutex;
+
+  /**
+   * Signaled when a chunk got counted or a worker failed.
+   */
+  pthread_cond_t cond;
+
+  /**
+   * Number of line ends in each chunk.
+   */
+  uintmax_t *counts;
+
+  /**
+   * Set for each chunk once counted.
+   */
+  bool *done;
+
+  /**
+   * Number of chunks in @ref counts.
+   */
+  size_t nchunks;
+
+  /**
+   * Index of the next chunk to count.
+   */
+  size_t next;
+
+  /**
+   * Size of the file.
+   */
+  off_t size;
+
+  /**
+   * File descriptor of the regular file.
+   */
+  int fd;
+
+  /**
+   * Byte ending each line, see @ref head::delim.
+   */
+  char delim;
+
+  /**
+   * Stop counting more chunks.
+   */
+  bool stop;
+
+  /**
+   * A chunk could not get mapped.
+   */
+  bool failed;
+
+  /**
+   * Padding for alignment.
+   */
+  char pad[1];
+};
+
+/**
+ * Worker thread counting the line ends in chunks of a @ref head_pscan.
+ *
+ * @param[in,out] arg See @ref head_pscan.
+ * @return            Always NULL.
+ */
+static void *
+head_pscan_worker(void *arg){
+  struct head_pscan *const ps = arg;
+  uintmax_t n;
+  size_t i;
+  size_t len;
+  off_t off;
+  char *map;
+
+  pthread_mutex_lock(&ps->mutex);
+  while(!ps->stop && !ps->failed && ps->next < ps->nchunks){
+    i = ps->next++;
+    pthread_mutex_unlock(&ps->mutex);
+
+    off = (off_t)i * (off_t)g_head_pscan_chunk;
+    len = g_head_pscan_chunk;
+    if(ps->size - off < (off_t)len){
+      len = (size_t)(ps->size - off);
+    }
+    n = UINTMAX_MAX;
+    map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, ps->fd, off);
+    if(map != MAP_FAILED){
+      madvise(map, len, MADV_SEQUENTIAL);
+      head_scan(map, len, ps->delim, &n);
+      munmap(map, len);
+    }
+
+    pthread_mutex_lock(&ps->mutex);
+    if(map == MAP_FAILED){
+      ps->failed = true;
+    }
+    ps->counts[i] = UINTMAX_MAX - n;
+    ps->done[i] = true;
+    pthread_cond_broadcast(&ps->cond);
+  }
+  pthread_mutex_unlock(&ps->mutex);
+  return NULL;
+}
+
+/**
+ * Count the line ends of the chunks after the first one in parallel.
+ *
+ * Stops the workers as soon as the chunks counted in order hold the
+ * remaining lines.
+ *
+ * @param[in]     head   See @ref head.
+ * @param[in,out] ps     See @ref head_pscan.
+ * @param[in,out] remain Number of lines left after the first chunk,
+ *                       reduced by the lines in the chunks before
+ *                       @p target.
+ * @param[out]    target Index of the chunk holding the last line wanted,
+ *                       or @ref head_pscan::nchunks if the file ends
+ *                       first.
+ * @retval        0      Counted the chunks.
+ * @retval        -1     Failed to start any worker or to map a chunk.
+ */
+static int
+head_pscan_count(const struct head *const head,
+                 struct head_pscan *const ps,
+                 uintmax_t *const remain,
+                 size_t *const target){
+  pthread_t *threads;
+  uintmax_t left;
+  size_t nthreads;
+  size_t max;
+  size_t i;
+  bool failed;
+
+  max = head->scan_threads;
+  if(max > ps->nchunks - 1){
+    max = ps->nchunks - 1;
+  }
+  threads = malloc(max * sizeof(*threads));
+  if(threads == NULL){
+    return -1;
+  }
+  for(nthreads = 0; nthreads < max; nthreads++){
+    if(pthread_create(&threads[nthreads],
+                      NULL,
+                      head_pscan_worker,
+                      ps) != 0){
+      break;
+    }
+  }
+  left = *remain;
+  failed = (nthreads == 0);
+  pthread_mutex_lock(&ps->mutex);
+  for(i = 1; !failed && i < ps->nchunks; i++){
+    while(!ps->done[i] && !ps->failed){
+      pthread_cond_wait(&ps->cond, &ps->mutex);
+    }
+    failed = ps->failed;
+    if(failed || ps->counts[i] >= left){
+      break;
+    }
+    left -= ps->counts[i];
+  }
+  ps->stop = true;
+  pthread_mutex_unlock(&ps->mutex);
+  while(nthreads > 0){
+    nthreads -= 1;
+    pthread_join(threads[nthreads], NULL);
+  }
+  free(threads);
+  if(failed){
+    return -1;
+  }
+  *remain = left;
+  *target = i;
+  return 0;
+}
+
+/**
+ * Print head lines from a large regular file, counting its lines with
+ * @ref head::scan_threads threads.
+ *
+ * The first chunk gets scanned in the calling thread, so asking for the
+ * first few lines costs no more than a serial scan. Further chunks get
+ * counted in parallel, the chunk holding the last line wanted gets scanned
+ * again to find the exact end of that line, and the whole range gets
+ * printed at once by @ref head_range. If the workers fail, the rest of the
+ * file gets scanned by @ref head_mmap instead.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor of a regular file.
+ * @param[in]     size Size of the file, at least @ref HEAD_PSCAN_MIN_CHUNKS
+ *                     chunks.
+ * @param[in]     name File name used in error messages.
+ */
+static void
+head_pscan(struct head *const head,
+           const int fd,
+           const off_t size,
+           const char *const name){
+  struct head_pscan ps;
+  uintmax_t remain;
+  size_t target;
+  size_t len;
+  off_t cut;
+  off_t off;
+  char *map;
+
+  map = mmap(NULL, g_head_pscan_chunk, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(map == MAP_FAILED){
+    head_mmap(head, fd, 0, size, name);
+    return;
+  }
+  madvise(map, g_head_pscan_chunk, MADV_SEQUENTIAL);
+  remain = head->remain;
+  cut = (off_t)head_scan(map, g_head_pscan_chunk, head->delim, &remain);
+  munmap(map, g_head_pscan_chunk);
+
+  memset(&ps, 0, sizeof(ps));
+  ps.nchunks = (size_t)((size + (off_t)g_head_pscan_chunk - 1) /
+                        (off_t)g_head_pscan_chunk);
+  ps.size = size;
+  ps.fd = fd;
+  ps.delim = head->delim;
+  if(remain > 0){
+    ps.counts = calloc(ps.nchunks, sizeof(*ps.counts));
+    ps.done = calloc(ps.nchunks, sizeof(*ps.done));
+  }
+  pthread_mutex_init(&ps.mutex, NULL);
+  pthread_cond_init(&ps.cond, NULL);
+  if(ps.counts && ps.done &&
+     head_pscan_count(head, &ps, &remain, &target) == 0){
+    head_engine(head, HEAD_ENGINE_PSCAN);
+    cut = size;
+    if(target < ps.nchunks){
+      off = (off_t)target * (off_t)g_head_pscan_chunk;
+      len = g_head_pscan_chunk;
+      if(size - off < (off_t)len){
+        len = (size_t)(size - off);
+      }
+      cut = off;
+      map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, off);
+      if(map != MAP_FAILED){
+        madvise(map, len, MADV_SEQUENTIAL);
+        cut += (off_t)head_scan(map, len, head->delim, &remain);
+        munmap(map, len);
+      }
+    }
+  }
+  pthread_cond_destroy(&ps.cond);
+  pthread_mutex_destroy(&ps.mutex);
+  free(ps.counts);
+  free(ps.done);
+  if(head_range(head, fd, 0, cut, name) < 0){
+    remain = 0;
+  }
+  head->remain = remain;
+  head_mmap(head, fd, cut, size, name);
+}
+
+/**
+ * Print head lines or bytes from a regular file.
+ *
+ * In byte mode, the range to print follows from the file size. When the
+ * number of lines wanted is at least the size of the file, the whole file
+ * gets printed without counting lines. In both cases the range gets printed
+ * by @ref head_range. Otherwise the file gets scanned by @ref head_mmap,
+ * by @ref head_index when asking for many lines with an index directory
+ * set or the file held by the (--serve) cache, or by @ref head_pscan when
+ * the file is large enough to count its lines in parallel.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor of a regular file.
+ * @param[in]     sb   File status of @p fd.
+ * @param[in]     name File name used in error messages.
+ */
+static void
+head_reg(struct head *const head,
+         const int fd,
+         const struct stat *const sb,
+         const char *const name){
+  const off_t size = sb->st_size;
+
+  head->sparse = sb->st_blocks < (size + 511) / 512;
+  if(head->elide){
+    head_elide_reg(head, fd, size, name);
+  }
+  else if(head->bytes && head->remain < (uintmax_t)size){
+    head_range(head, fd, 0, (off_t)head->remain, name);
+  }
+  else if(head->remain >= (uintmax_t)size){
+    head->stats.lines_known = false;
+    head_range(head, fd, 0, size, name);
+  }
+  else if((head->index_dir || head->cached) && !head->bytes &&
+          head->remain >= HEAD_INDEX_INTERVAL){
+    head_index(head, fd, sb, name);
+  }
+  else if(head->scan_threads > 1 && !head->bytes && !head->sparse &&
+          size >= (off_t)(HEAD_PSCAN_MIN_CHUNKS * g_head_pscan_chunk)){
+    head_pscan(head, fd, size, name);
+  }
+  else{
+    head_mmap(head, fd, 0, size, name);
+  }
+}
+
+/**
+ * Close a file opened by @ref head_cache_open, or give its cache entry
+ * back for use by other requests.
+ *
+ * A file that failed to get rewound gets dropped from the cache.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor returned by @ref head_cache_open.
+ * @retval        0    Closed the file or gave back its entry.
+ * @retval        -1   Failed to close the file.
+ */
+static int
+head_cache_close(struct head *const head,
+                 const int fd){
+  struct head_cache_entry *const ent = head->cached;
+
+  if(ent == NULL){
+    return close(fd);
+  }
+  if(fd < 0){
+    close(ent->fd);
+    ent->fd = -1;
+  }
+  head->cached = NULL;
+  pthread_mutex_lock(&head->cache->mutex);
+  ent->busy = false;
+  pthread_mutex_unlock(&head->cache->mutex);
+  return 0;
+}
+
+/**
+ * Open a file, reusing a file descriptor kept by the (--serve) cache.
+ *
+ * An unused cache entry for the same device and inode gets taken for
+ * exclusive use by the request and rewound. Otherwise the file gets opened
+ * and, if regular and not cached yet, takes over the least recently used
+ * entry not in use. The entry taken gets stored in @ref head::cached.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     path File path.
+ * @return        File descriptor, or -1 with errno set if open failed.
+ */
+static int
+head_cache_open(struct head *const head,
+                const char *const path){
+  struct head_cache *const cache = head->cache;
+  struct head_cache_entry *ent;
+  struct head_cache_entry *lru;
+  struct stat sb;
+  size_t i;
+  int fd;
+
+  if(stat(path, &sb) == 0 && S_ISREG(sb.st_mode)){
+    pthread_mutex_lock(&cache->mutex);
+    for(i = 0; i < HEAD_CACHE_SIZE; i++){
+      ent = &cache->ent[i];
+      if(ent->fd >= 0 && !ent->busy &&
+         ent->dev == sb.st_dev && ent->ino == sb.st_ino){
+        ent->busy = true;
+        ent->used = ++cache->clock;
+        head->cached = ent;
+        break;
+      }
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    if(head->cached){
+      if(lseek(head->cached->fd, 0, SEEK_SET) == 0){
+        return head->cached->fd;
+      }
+      head_cache_close(head, -1);
+    }
+  }
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd < 0 || fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode)){
+    return fd;
+  }
+  lru = NULL;
+  pthread_mutex_lock(&cache->mutex);
+  for(i = 0; i < HEAD_CACHE_SIZE; i++){
+    ent = &cache->ent[i];
+    if(ent->fd >= 0 && ent->dev == sb.st_dev && ent->ino == sb.st_ino){
+      lru = NULL;
+      break;
+    }
+    if(!ent->busy && (lru == NULL || ent->used < lru->used)){
+      lru = ent;
+    }
+  }
+  if(lru){
+    lru->busy = true;
+    lru->used = ++cache->clock;
+  }
+  pthread_mutex_unlock(&cache->mutex);
+  if(lru){
+    if(lru->fd >= 0){
+      close(lru->fd);
+    }
+    free(lru->idx.off);
+    memset(&lru->idx, 0, sizeof(lru->idx));
+    lru->dev = sb.st_dev;
+    lru->ino = sb.st_ino;
+    lru->fd = fd;
+    head->cached = lru;
+  }
+  return fd;
+}
+
+/**
+ * Position reached in a file printed with (--resume).
+ */
+struct head_resume_pos{
+  /**
+   * Device of the file.
+   */
+  unsigned long dev;
+
+  /**
+   * Inode of the file, or 0 if no file got printed yet.
+   */
+  unsigned long ino;
+
+  /**
+   * Offset after the last line printed so far.
+   */
+  unsigned long off;
+
+  /**
+   * Number of lines printed so far.
+   */
+  unsigned long lines;
+};
+
+/**
+ * Checkpoint of a file path printed with (--resume).
+ */
+struct head_resume_entry{
+  /**
+   * File path as given on the command line.
+   */
+  char *path;
+
+  /**
+   * Position read from the state file, kept for paths taking over the
+   * checkpoint of a rotated file.
+   */
+  struct head_resume_pos prev;
+
+  /**
+   * Position saved to the state file.
+   */
+  struct head_resume_pos pos;
+};
+
+/**
+ * Checkpoints kept in a (--resume) state file.
+ */
+struct head_resume{
+  /**
+   * Path of the state file.
+   */
+  const char *path;
+
+  /**
+   * Checkpoints, one per file path.
+   */
+  struct head_resume_entry *ent;
+
+  /**
+   * Number of checkpoints in @ref ent.
+   */
+  size_t len;
+
+  /**
+   * Number of checkpoints allocated in @ref ent.
+   */
+  size_t size;
+};
+
+/**
+ * Free the checkpoints of a (--resume) state file.
+ *
+ * @param[in,out] resume See @ref head_resume.
+ */
+static void
+head_resume_free(struct head_resume *const resume){
+  size_t i;
+
+  for(i = 0; i < resume->len; i++){
+    free(resume->ent[i].path);
+  }
+  free(resume->ent);
+  resume->ent = NULL;
+  resume->len = 0;
+  resume->size = 0;
+}
+
+/**
+ * Add an empty checkpoint for a file path.
+ *
+ * @param[in,out] head   See @ref head.
+ * @param[in,out] resume See @ref head_resume.
+ * @param[in]     path   File path.
+ * @return               New checkpoint, or NULL if out of memory.
+ */
+static struct head_resume_entry *
+head_resume_add(struct head *const head,
+                struct head_resume *const resume,
+                const char *const path){
+  struct head_resume_entry *ent;
+  void *mem;
+
+  if(resume->len == resume->size){
+    mem = realloc(resume->ent, (resume->size * 2 + 16) * sizeof(*ent));
+    if(mem == NULL){
+      head_warn(head, true, "realloc");
+      return NULL;
+    }
+    resume->ent = mem;
+    resume->size = resume->size * 2 + 16;
+  }
+  ent = &resume->ent[resume->len];
+  memset(ent, 0, sizeof(*ent));
+  ent->path = malloc(strlen(path) + 1);
+  if(ent->path == NULL){
+    head_warn(head, true, "malloc");
+    return NULL;
+  }
+  strcpy(ent->path, path);
+  resume->len += 1;
+  return ent;
+}
+
+/**
+ * Read the checkpoints of a (--resume) state file.
+ *
+ * The state file starts with @ref HEAD_RESUME_MAGIC, followed by a line
+ * per file holding its device, inode, offset and number of lines printed,
+ * then its path. A missing state file holds no checkpoint, as on the first
+ * run.
+ *
+ * @param[in,out] head   See @ref head.
+ * @param[out]    resume See @ref head_resume.
+ * @param[in]     path   State file.
+ * @retval        0      Read all checkpoints.
+ * @retval        -1     Failed to read the state file, or it is invalid.
+ */
+static int
+head_resume_load(struct head *const head,
+                 struct head_resume *const resume,
+                 const char *const path){
+  struct head_resume_entry *ent;
+  unsigned long field[4];
+  char *line;
+  size_t cap;
+  ssize_t len;
+  FILE *fp;
+  int pos;
+  int rc;
+
+  memset(resume, 0, sizeof(*resume));
+  resume->path = path;
+  fp = fopen(path, "r");
+  if(fp == NULL){
+    if(errno == ENOENT){
+      return 0;
+    }
+    head_warn(head, true, "open: %s", path);
+    return -1;
+  }
+  line = NULL;
+  cap = 0;
+  len = getline(&line, &cap, fp);
+  rc = (len < 0 || strcmp(line, HEAD_RESUME_MAGIC) != 0) ? -1 : 0;
+  while(rc == 0 && (len = getline(&line, &cap, fp)) > 0){
+    pos = 0;
+    if(line[len - 1] != '\n' ||
+       sscanf(line,
+              "%lu %lu %lu %lu%n",
+              &field[0],
+              &field[1],
+              &field[2],
+              &field[3],
+              &pos) != 4 ||
+       line[pos] != ' ' ||
+       pos + 2 >= len){
+      rc = -1;
+      break;
+    }
+    line[len - 1] = '\0';
+    ent = head_resume_add(head, resume, line + pos + 1);
+    if(ent == NULL){
+      rc = -2;
+      break;
+    }
+    ent->prev.dev = field[0];
+    ent->prev.ino = field[1];
+    ent->prev.off = field[2];
+    ent->prev.lines = field[3];
+    ent->pos = ent->prev;
+  }
+  if(ferror(fp)){
+    head_warn(head, true, "read: %s", path);
+    rc = -2;
+  }
+  else if(rc == -1){
+    head_warn(head, false, "%s: invalid state file", path);
+  }
+  free(line);
+  fclose(fp);
+  if(rc < 0){
+    head_resume_free(resume);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Atomically replace the (--resume) state file with the current
+ * checkpoints.
+ *
+ * @param[in,out] head See @ref head.
+ */
+static void
+head_resume_save(struct head *const head){
+  const struct head_resume *const resume = head->resume;
+  const struct head_resume_entry *ent;
+  char *tmp;
+  FILE *fp;
+  size_t i;
+  bool ok;
+  int fd;
+
+  tmp = malloc(strlen(resume->path) + sizeof(".XXXXXX"));
+  if(tmp == NULL){
+    head_warn(head, true, "malloc");
+    return;
+  }
+  sprintf(tmp, "%s.XXXXXX", resume->path);
+  fd = mkstemp(tmp);
+  fp = (fd < 0) ? NULL : fdopen(fd, "w");
+  if(fp == NULL){
+    head_warn(head, true, "write: %s", resume->path);
+    if(fd >= 0){
+      close(fd);
+      unlink(tmp);
+    }
+    free(tmp);
+    return;
+  }
+  fputs(HEAD_RESUME_MAGIC, fp);
+  for(i = 0; i < resume->len; i++){
+    ent = &resume->ent[i];
+    fprintf(fp,
+            "%lu %lu %lu %lu %s\n",
+            ent->pos.dev,
+            ent->pos.ino,
+            ent->pos.off,
+            ent->pos.lines,
+            ent->path);
+  }
+  ok = (fflush(fp) == 0 && fsync(fd) == 0);
+  if(fclose(fp) != 0 || !ok || rename(tmp, resume->path) != 0){
+    head_warn(head, true, "write: %s", resume->path);
+    unlink(tmp);
+  }
+  free(tmp);
+}
+
+/**
+ * Find the end of the lines of a regular file to print with (--resume).
+ *
+ * Only complete lines count, so a line still getting written at the end
+ * of the file gets printed by a later run once complete.
+ *
+ * @param[in,out] head  See @ref head, with @ref head::remain decremented
+ *                      by the number of lines found.
+ * @param[in]     fd    File descriptor of a regular file.
+ * @param[in]     start Offset of the first line.
+ * @param[in]     size  Size of the file in bytes.
+ * @param[in]     name  File name used in error messages.
+ * @param[out]    end   Offset after the last line found.
+ * @retval        0     Found the end.
+ * @retval        -1    Error occurred.
+ */
+static int
+head_resume_end(struct head *const head,
+                const int fd,
+                const off_t start,
+                const off_t size,
+                const char *const name,
+                off_t *const end){
+  const char *p;
+  off_t off;
+  off_t map_off;
+  size_t winlen;
+  size_t skip;
+  size_t len;
+  char *map;
+
+  *end = start;
+  off = start;
+  while(head->remain > 0 && off < size){
+    map_off = off - off % HEAD_MMAP_WINDOW;
+    winlen = HEAD_MMAP_WINDOW;
+    if(size - map_off < (off_t)winlen){
+      winlen = (size_t)(size - map_off);
+    }
+    map = mmap(NULL, winlen, PROT_READ, MAP_PRIVATE, fd, map_off);
+    if(map == MAP_FAILED){
+      head_warn(head, true, "mmap: %s", name);
+      return -1;
+    }
+    madvise(map, winlen, MADV_SEQUENTIAL);
+    skip = (size_t)(off - map_off);
+    len = head_scan(map + skip, winlen - skip, head->delim, &head->remain);
+    if(head->remain == 0){
+      *end = off + (off_t)len;
+    }
+    else{
+      p = memrchr(map + skip, head->delim, winlen - skip);
+      if(p){
+        *end = map_off + (p - map) + 1;
+      }
+    }
+    munmap(map, winlen);
+    off = map_off + (off_t)winlen;
+  }
+  return 0;
+}
+
+/**
+ * Check whether a position belongs to the current version of a file.
+ *
+ * @param[in] pos See @ref head_resume_pos.
+ * @param[in] sb  File status of the file.
+ * @retval    true  Same file, and not truncated below the position.
+ * @retval    false Another file, or truncated.
+ */
+static bool
+head_resume_match(const struct head_resume_pos *const pos,
+                  const struct stat *const sb){
+  return pos->dev == (unsigned long)sb->st_dev &&
+         pos->ino == (unsigned long)sb->st_ino &&
+         pos->off <= (unsigned long)sb->st_size;
+}
+
+/**
+ * Print the lines added to a regular file since the previous run.
+ *
+ * Corresponds to the (--resume) argument.
+ *
+ * Printing continues at the offset kept in the checkpoint of the path,
+ * unless the path now refers to another file, as after a log rotation, or
+ * the file got truncated below that offset. Both cases start over at the
+ * beginning of the file, or at the position the previous run reached in
+ * the same file under another path, so a rotated log listed under its new
+ * name continues where the old name stopped. The lines found by
+ * @ref head_resume_end get printed by @ref head_range, and the checkpoint
+ * moves past them.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor of a regular file.
+ * @param[in]     sb   File status of @p fd.
+ * @param[in]     name File name used in error messages.
+ */
+static void
+head_resume_reg(struct head *const head,
+                const int fd,
+                const struct stat *const sb,
+                const char *const name){
+  struct head_resume_entry *ent;
+  uintmax_t want;
+  uintmax_t remain;
+  size_t i;
+  off_t start;
+  off_t end;
+
+  if(strchr(name, '\n')){
+    head_warn(head, false, "%s: cannot resume a file name with a newline",
+              name);
+    return;
+  }
+  ent = NULL;
+  for(i = 0; i < head->resume->len && ent == NULL; i++){
+    if(strcmp(head->resume->ent[i].path, name) == 0){
+      ent = &head->resume->ent[i];
+    }
+  }
+  if(ent == NULL){
+    ent = head_resume_add(head, head->resume, name);
+    if(ent == NULL){
+      return;
+    }
+  }
+  if(!head_resume_match(&ent->pos, sb)){
+    memset(&ent->pos, 0, sizeof(ent->pos));
+    for(i = 0; i < head->resume->len; i++){
+      if(head_resume_match(&head->resume->ent[i].prev, sb)){
+        ent->pos = head->resume->ent[i].prev;
+        break;
+      }
+    }
+  }
+  start = (off_t)ent->pos.off;
+  want = head->remain;
+  if(head_resume_end(head, fd, start, sb->st_size, name, &end) < 0){
+    return;
+  }
+  remain = head->remain;
+  if(end > start && head_range(head, fd, start, end, name) < 0){
+    return;
+  }
+  head->remain = remain;
+  ent->pos.dev = (unsigned long)sb->st_dev;
+  ent->pos.ino = (unsigned long)sb->st_ino;
+  ent->pos.off = (unsigned long)end;
+  ent->pos.lines += (unsigned long)(want - remain);
+}
+
+/**
+ * Open a file path and print its head lines.
+ *
+ * The file gets opened here unless @ref head_prefetch opened it already.
+ * Non-empty regular files get printed by @ref head_reg and everything else
+ * (pipes, devices, files in /proc reporting a zero size) by
+ * @ref head_stream. With (--resume), regular files get printed by
+ * @ref head_resume_reg instead. With (--decompress), regular files starting
+ * with the gzip magic bytes get decompressed by @ref head_gz.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     path File path.
+ * @param[in]     fd   File descriptor of @p path returned by
+ *                     @ref head_prefetch, or -1 to open @p path.
+ */
+static void
+head_path_fd(struct head *const head,
+             const char *const path,
+             int fd){
+  struct stat sb;
+#ifdef HEAD_ZLIB
+  char magic[2];
+#endif /* HEAD_ZLIB */
+
+  head_stats_begin(head);
+  head_reset(head);
+  if(fd < 0){
+    fd = head->cache ? head_cache_open(head, path) : open(path, O_RDONLY);
+  }
+  HEAD_PROBE2(file__open, path, fd);
+  if(fd < 0){
+    head_warn(head, true, "open: %s", path);
+  }
+  else{
+    if(fstat(fd, &sb) != 0){
+      head_warn(head, true, "fstat: %s", path);
+    }
+    else if(head->resume && S_ISREG(sb.st_mode)){
+      head_resume_reg(head, fd, &sb, path);
+    }
+#ifdef HEAD_ZLIB
+    else if(head->decompress && S_ISREG(sb.st_mode) &&
+            pread(fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+            head_gz_magic(magic, sizeof(magic))){
+      head_gz(head, fd, magic, 0, path);
+    }
+#endif /* HEAD_ZLIB */
+    else if(S_ISREG(sb.st_mode) && sb.st_size > 0){
+      head_reg(head, fd, &sb, path);
+    }
+    else{
+      head_stream(head, fd, path);
+    }
+    if(head_cache_close(head, fd) != 0){
+      head_warn(head, true, "close: %s", path);
+    }
+    HEAD_PROBE2(file__close, path, head->status_code);
+  }
+  head_flush(head);
+  head_stats_end(head, path);
+}
+
+/**
+ * Open a file path and print its head lines.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     path File path.
+ */
+static void
+head_path(struct head *const head,
+          const char *const path){
+  head_path_fd(head, path, -1);
+}
+
+/**
+ * Queue the banner in front of a file when printing multiple files.
+ *
+ * The banner gets written by the next @ref head_write together with the
+ * first bytes of the file, so that each small file takes a single write.
+ *
+ * @param[in,out] head  See @ref head.
+ * @param[in]     path  File path.
+ * @param[in]     first Set for the first file, which has no blank line
+ *                      before the banner.
+ */
+static void
+head_banner(struct head *const head,
+            const char *const path,
+            const bool first){
+  struct head_obuf *obuf;
+
+  obuf = head->obuf ? head->obuf : &head->hdr;
+  if(!first){
+    head_append(head, obuf, "\n", 1);
+  }
+  head_append(head, obuf, "==> ", 4);
+  head_append(head, obuf, path, strlen(path));
+  head_append(head, obuf, " <==\n", 5);
+}
+
+/**
+ * Open an upcoming file operand early and start reading its head into the
+ * page cache, so that its I/O overlaps with printing the files before it.
+ *
+ * Only non-empty regular files get opened, with O_NONBLOCK in case the
+ * path got replaced by a FIFO since the stat() call. The flag gets cleared
+ * again right away, so that reading such a FIFO later waits for data just
+ * as if the file got opened when due. Beyond the bytes read ahead, the
+ * kernel doubles its read-ahead for the rest of the file. Errors are left
+ * for @ref head_path_fd to report once the file is due.
+ *
+ * @param[in] path File path.
+ * @param[in] len  Number of bytes to read ahead.
+ * @return         File descriptor, or -1 if not opened.
+ */
+static int
+head_prefetch(const char *const path,
+              const off_t len){
+  struct stat sb;
+  int fd;
+
+  if(stat(path, &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size == 0){
+    return -1;
+  }
+  fd = open(path, O_RDONLY | O_NONBLOCK);
+  if(fd < 0){
+    return -1;
+  }
+  if(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK) != 0){
+    close(fd);
+    return -1;
+  }
+  if(len < sb.st_size){
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+  posix_fadvise(fd, 0, len, POSIX_FADV_WILLNEED);
+  return fd;
+}
+
+/**
+ * Print files one after another, with a banner in front of each one if
+ * requested.
+ *
+ * While a file gets printed, the next files up to a total of
+ * @ref HEAD_PREFETCH_FILES are open with their heads getting read ahead
+ * by @ref head_prefetch, which bounds the number of open files. The bytes
+ * read ahead follow from (-c), or from (-n) and the average line length of
+ * the files printed so far, starting with @ref HEAD_PREFETCH_LINE bytes.
+ * Until that average is known, only the next file gets opened, so a wrong
+ * guess costs at most one file.
+ *
+ * Heads larger than @ref HEAD_PREFETCH_MAX bytes, and all but the last
+ * lines or bytes, get no read-ahead: the kernel read-ahead streams them
+ * just as well, and reading ahead only part of a head restarts it from a
+ * small window. Files of a (--serve) request come from its cache instead.
+ *
+ * @param[in,out] head   See @ref head.
+ * @param[in]     npaths Number of file operands in @p paths.
+ * @param[in]     paths  File operands.
+ * @param[in]     first  Index of the first file to print in @p paths.
+ * @param[in]     banner Print a banner in front of each file.
+ */
+static void
+head_serial(struct head *const head,
+            const size_t npaths,
+            char **const paths,
+            size_t first,
+            const bool banner){
+  int fds[HEAD_PREFETCH_FILES];
+  uintmax_t nbytes;
+  uintmax_t nlines;
+  uintmax_t avg;
+  uintmax_t len;
+  size_t depth;
+  size_t next;
+  size_t i;
+
+  nbytes = 0;
+  nlines = 0;
+  next = first;
+  for(i = first; i < npaths; i++){
+    len = 0;
+    depth = HEAD_PREFETCH_FILES;
+    if(head->elide){
+      depth = 1;
+    }
+    else if(head->bytes){
+      len = head->nbytes;
+    }
+    else{
+      avg = nlines ? nbytes / nlines + 1 : HEAD_PREFETCH_LINE;
+      len = HEAD_PREFETCH_MAX + 1;
+      if(head->nlines <= HEAD_PREFETCH_MAX / avg){
+        len = head->nlines * avg;
+      }
+      depth = nlines ? HEAD_PREFETCH_FILES : 2;
+    }
+    if(len == 0 || len > HEAD_PREFETCH_MAX){
+      depth = 1;
+    }
+    for(; next < npaths && next < i + depth; next++){
+      fds[next % HEAD_PREFETCH_FILES] = -1;
+      if(depth > 1 && npaths - first > 1 && head->cache == NULL){
+        fds[next % HEAD_PREFETCH_FILES] = head_prefetch(paths[next],
+                                                        (off_t)len);
+      }
+    }
+    if(banner){
+      head_banner(head, paths[i], head->nfiles + i == 0);
+    }
+    head_path_fd(head, paths[i], fds[i % HEAD_PREFETCH_FILES]);
+    if(!head->bytes && !head->elide && head->stats.lines_known &&
+       head->remain < head->nlines){
+      nbytes += head->stats.bytes_read;
+      nlines += head->nlines - head->remain;
+    }
+  }
+}
+
+/**
+ * One slot of the @ref head_pool output window.
+ */
+struct head_slot{
+  /**
+   * Output of the file operand assigned to this slot.
+   */
+  struct head_obuf obuf;
+
+  /**
+   * Counters of the file operand, see @ref head_stats_end.
+   */
+  struct head_stats stats;
+
+  /**
+   * Exit status of the worker processing the file operand.
+   */
+  int status_code;
+
+  /**
+   * Set once the worker has finished the file operand.
+   */
+  bool done;
+
+  /**
+   * Padding for alignment.
+   */
+  char pad[3];
+};
+
+/**
+ * Worker pool printing multiple files in parallel.
+ *
+ * Workers claim file operands in argument order and collect the output of
+ * each one in a slot of a window, which the main thread writes to STDOUT in
+ * argument order. Workers do not run more than the window size ahead of
+ * the oldest file not written yet.
+ */
+struct head_pool{
+  /**
+   * Protects all members below.
+   */
+  pthread_mutex_t mutex;
+
+  /**
+   * Signaled when a slot gets finished or written.
+   */
+  pthread_cond_t cond;
+
+  /**
+   * Options used by every worker.
+   */
+  const struct head *head;
+
+  /**
+   * File operands.
+   */
+  char **paths;
+
+  /**
+   * Output window with @ref nslots slots.
+   */
+  struct head_slot *slots;
+
+  /**
+   * Number of slots in @ref slots.
+   */
+  size_t nslots;
+
+  /**
+   * Number of file operands in @ref paths.
+   */
+  size_t npaths;
+
+  /**
+   * Index of the next file operand to claim.
+   */
+  size_t next;
+
+  /**
+   * Number of file operands written to STDOUT.
+   */
+  size_t written;
+};
+
+/**
+ * Worker thread claiming and printing files into the @ref head_pool window.
+ *
+ * @param[in,out] arg See @ref head_pool.
+ * @return            Always NULL.
+ */
+static void *
+head_pool_worker(void *arg){
+  struct head_pool *const pool = arg;
+  struct head_slot *slot;
+  struct head head;
+  size_t i;
+
+  head = *pool->head;
+  head.status_code = EXIT_SUCCESS;
+  head.copy = HEAD_COPY_NONE;
+  head.buf = NULL;
+  head.scan_threads = 1;
+  pthread_mutex_lock(&pool->mutex);
+  while(pool->next < pool->npaths){
+    if(pool->next - pool->written >= pool->nslots){
+      pthread_cond_wait(&pool->cond, &pool->mutex);
+      continue;
+    }
+    i = pool->next++;
+    slot = &pool->slots[i % pool->nslots];
+    pthread_mutex_unlock(&pool->mutex);
+
+    head.obuf = &slot->obuf;
+    head.status_code = EXIT_SUCCESS;
+    head_banner(&head, pool->paths[i], head.nfiles + i == 0);
+    head_path(&head, pool->paths[i]);
+
+    pthread_mutex_lock(&pool->mutex);
+    slot->status_code = head.status_code;
+    slot->stats = head.stats;
+    slot->done = true;
+    pthread_cond_broadcast(&pool->cond);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  free(head.buf);
+  return NULL;
+}
+
+/**
+ * Print multiple files using @ref head::jobs worker threads.
+ *
+ * The output is identical to printing the files one after another.
+ *
+ * @param[in,out] head   See @ref head.
+ * @param[in]     npaths Number of file operands in @p paths.
+ * @param[in]     paths  File operands.
+ * @retval        0      Printed all files.
+ * @retval        -1     Failed to start any worker, nothing printed.
+ */
+static int
+head_pool_run(struct head *const head,
+              const size_t npaths,
+              char **const paths){
+  struct head_pool pool;
+  struct head_slot *slot;
+  pthread_t *threads;
+  size_t nthreads;
+  size_t i;
+
+  memset(&pool, 0, sizeof(pool));
+  pool.head = head;
+  pool.paths = paths;
+  pool.npaths = npaths;
+  pool.nslots = head->jobs * 2;
+  pool.slots = calloc(pool.nslots, sizeof(*pool.slots));
+  threads = malloc(head->jobs * sizeof(*threads));
+  if(pool.slots == NULL || threads == NULL){
+    free(pool.slots);
+    free(threads);
+    return -1;
+  }
+  pthread_mutex_init(&pool.mutex, NULL);
+  pthread_cond_init(&pool.cond, NULL);
+  for(nthreads = 0; nthreads < head->jobs; nthreads++){
+    if(pthread_create(&threads[nthreads],
+                      NULL,
+                      head_pool_worker,
+                      &pool) != 0){
+      break;
+    }
+  }
+  if(nthreads > 0){
+    for(i = 0; i < npaths; i++){
+      slot = &pool.slots[i % pool.nslots];
+      pthread_mutex_lock(&pool.mutex);
+      while(!slot->done){
+        pthread_cond_wait(&pool.cond, &pool.mutex);
+      }
+      pthread_mutex_unlock(&pool.mutex);
+
+      if(slot->status_code != EXIT_SUCCESS){
+        head->status_code = slot->status_code;
+      }
+      head->stats = slot->stats;
+      head_write(head, slot->obuf.data, slot->obuf.len);
+      if(head->stats_fp){
+        head_stats_report(head, paths[i], &head->stats);
+      }
+
+      pthread_mutex_lock(&pool.mutex);
+      slot->obuf.len = 0;
+      slot->done = false;
+      pool.written += 1;
+      pthread_cond_broadcast(&pool.cond);
+      pthread_mutex_unlock(&pool.mutex);
+    }
+    for(i = 0; i < nthreads; i++){
+      pthread_join(threads[i], NULL);
+    }
+  }
+  pthread_cond_destroy(&pool.cond);
+  pthread_mutex_destroy(&pool.mutex);
+  for(i = 0; i < pool.nslots; i++){
+    free(pool.slots[i].obuf.data);
+  }
+  free(pool.slots);
+  free(threads);
+  return nthreads > 0 ? 0 : -1;
+}
+
+#ifdef HEAD_URING
+/**
+ * Operation type stored in the upper bits of the io_uring user data, with
+ * the index of the file in the batch in the lower bits.
+ */
+enum head_uring_op{
+  /**
+   * Open the file.
+   */
+  HEAD_URING_OPEN = 1 << 8,
+
+  /**
+   * Read the first window of the file.
+   */
+  HEAD_URING_READ = 2 << 8
+};
+
+/**
+ * State of one file in a batch of @ref head_uring_run.
+ */
+struct head_uring_file{
+  /**
+   * File descriptor, or negative errno if the open failed.
+   */
+  int fd;
+
+  /**
+   * Number of bytes read into the window, or negative errno.
+   */
+  int res;
+
+  /**
+   * Set once the open of the file completed.
+   */
+  bool opened;
+
+  /**
+   * Set once the read of the file got queued.
+   */
+  bool reading;
+
+  /**
+   * Set once the open and read of the file completed.
+   */
+  bool ready;
+
+  /**
+   * Padding for alignment.
+   */
+  char pad[5];
+};
+
+/**
+ * Memory mapped io_uring submission and completion queues.
+ */
+struct head_uring{
+  /**
+   * Submission queue entries.
+   */
+  struct io_uring_sqe *sqes;
+
+  /**
+   * Completion queue entries.
+   */
+  struct io_uring_cqe *cqes;
+
+  /**
+   * Submission queue ring mapping.
+   */
+  char *sq_ring;
+
+  /**
+   * Completion queue ring mapping, may equal @ref sq_ring.
+   */
+  char *cq_ring;
+
+  /**
+   * Number of bytes mapped at @ref sq_ring.
+   */
+  size_t sq_ring_size;
+
+  /**
+   * Number of bytes mapped at @ref cq_ring.
+   */
+  size_t cq_ring_size;
+
+  /**
+   * Number of bytes mapped at @ref sqes.
+   */
+  size_t sqes_size;
+
+  /**
+   * Kernel parameters and ring offsets.
+   */
+  struct io_uring_params params;
+
+  /**
+   * io_uring file descriptor.
+   */
+  int fd;
+
+  /**
+   * Number of entries queued but not submitted yet.
+   */
+  unsigned int queued;
+
+  /**
+   * Number of entries queued or submitted and not completed yet.
+   */
+  unsigned int inflight;
+};
+
+/**
+ * Get a pointer to a field of a ring mapping.
+ *
+ * @param[in] ring Ring mapping.
+ * @param[in] off  Offset of the field.
+ * @return         Pointer to the field.
+ */
+static unsigned int *
+head_uring_field(char *const ring,
+                 const unsigned int off){
+  return (unsigned int *)(void *)(ring + off);
+}
+
+/**
+ * Tear down the queues set up by @ref head_uring_init.
+ *
+ * @param[in,out] uring See @ref head_uring.
+ */
+static void
+head_uring_free(struct head_uring *const uring){
+  if(uring->sqes != MAP_FAILED){
+    munmap(uring->sqes, uring->sqes_size);
+  }
+  if(uring->cq_ring != MAP_FAILED && uring->cq_ring != uring->sq_ring){
+    munmap(uring->cq_ring, uring->cq_ring_size);
+  }
+  if(uring->sq_ring != MAP_FAILED){
+    munmap(uring->sq_ring, uring->sq_ring_size);
+  }
+  if(uring->fd >= 0){
+    close(uring->fd);
+  }
+}
+
+/**
+ * Set up an io_uring instance and map its queues.
+ *
+ * @param[out] uring See @ref head_uring.
+ * @retval     0     Ready to queue operations.
+ * @retval     -1    io_uring not available.
+ */
+static int
+head_uring_init(struct head_uring *const uring){
+  struct io_uring_params *const p = &uring->params;
+  long rc;
+
+  memset(uring, 0, sizeof(*uring));
+  uring->sq_ring = MAP_FAILED;
+  uring->cq_ring = MAP_FAILED;
+  uring->sqes = MAP_FAILED;
+  rc = syscall(__NR_io_uring_setup, (unsigned int)HEAD_URING_DEPTH, p);
+  uring->fd = (int)rc;
+  if(rc < 0 || !(p->features & IORING_FEAT_RW_CUR_POS)){
+    head_uring_free(uring);
+    return -1;
+  }
+  uring->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+  uring->cq_ring_size = p->cq_off.cqes +
+                        p->cq_entries * sizeof(struct io_uring_cqe);
+  if(p->features & IORING_FEAT_SINGLE_MMAP){
+    if(uring->cq_ring_size > uring->sq_ring_size){
+      uring->sq_ring_size = uring->cq_ring_size;
+    }
+    uring->cq_ring_size = uring->sq_ring_size;
+  }
+  uring->sq_ring = mmap(NULL,
+                        uring->sq_ring_size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE,
+                        uring->fd,
+                        IORING_OFF_SQ_RING);
+  if(uring->sq_ring == MAP_FAILED){
+    head_uring_free(uring);
+    return -1;
+  }
+  if(p->features & IORING_FEAT_SINGLE_MMAP){
+    uring->cq_ring = uring->sq_ring;
+  }
+  else{
+    uring->cq_ring = mmap(NULL,
+                          uring->cq_ring_size,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE,
+                          uring->fd,
+                          IORING_OFF_CQ_RING);
+  }
+  uring->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+  uring->sqes = mmap(NULL,
+                     uring->sqes_size,
+                     PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE,
+                     uring->fd,
+                     IORING_OFF_SQES);
+  if(uring->cq_ring == MAP_FAILED || uring->sqes == MAP_FAILED){
+    head_uring_free(uring);
+    return -1;
+  }
+  uring->cqes = (struct io_uring_cqe *)(void *)(uring->cq_ring +
+                                                p->cq_off.cqes);
+  return 0;
+}
+
+/**
+ * Queue an operation in the submission queue.
+ *
+ * The queue never fills up because every file in a batch has at most one
+ * operation in flight.
+ *
+ * @param[in,out] uring See @ref head_uring.
+ * @param[in]     op    Operation code.
+ * @param[in]     fd    File descriptor or directory file descriptor.
+ * @param[in]     addr  Path or buffer address.
+ * @param[in]     len   Buffer size.
+ * @param[in]     data  User data identifying the operation.
+ */
+static void
+head_uring_queue(struct head_uring *const uring,
+                 const unsigned char op,
+                 const int fd,
+                 const void *const addr,
+                 const unsigned int len,
+                 const unsigned int data){
+  unsigned int *const tail = head_uring_field(uring->sq_ring,
+                                              uring->params.sq_off.tail);
+  const unsigned int mask = *head_uring_field(uring->sq_ring,
+                                              uring->params.sq_off.ring_mask);
+  struct io_uring_sqe *sqe;
+  unsigned int t;
+
+  t = *tail;
+  sqe = &uring->sqes[t & mask];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = op;
+  sqe->fd = fd;
+  sqe->addr = (uintptr_t)addr;
+  sqe->len = len;
+  sqe->user_data = data;
+  if(op == IORING_OP_OPENAT){
+    sqe->open_flags = O_RDONLY;
+  }
+  else if(op == IORING_OP_READ){
+    sqe->off = ~(__u64)0;
+  }
+  head_uring_field(uring->sq_ring, uring->params.sq_off.array)[t & mask] =
+    t & mask;
+  __atomic_store_n(tail, t + 1, __ATOMIC_RELEASE);
+  uring->queued += 1;
+  uring->inflight += 1;
+}
+
+/**
+ * Submit queued operations and wait for at least one completion.
+ *
+ * @param[in,out] uring     See @ref head_uring.
+ * @param[in]     to_submit Number of queued operations to submit.
+ * @retval        0         Submitted the operations.
+ * @retval        -1        Failed to submit the operations or to wait.
+ */
+static int
+head_uring_enter(struct head_uring *const uring,
+                 const unsigned int to_submit){
+  long rc;
+
+  do{
+    rc = syscall(__NR_io_uring_enter,
+                 uring->fd,
+                 to_submit,
+                 1u,
+                 (unsigned int)IORING_ENTER_GETEVENTS,
+                 (void *)NULL,
+                 (size_t)0);
+  } while(rc < 0 && errno == EINTR);
+  if(rc < 0){
+    return -1;
+  }
+  uring->queued -= (unsigned int)rc;
+  return 0;
+}
+
+/**
+ * Record the completed operations in the state of their files.
+ *
+ * @param[in,out] uring See @ref head_uring.
+ * @param[in,out] files Files of the current batch.
+ */
+static void
+head_uring_reap(struct head_uring *const uring,
+                struct head_uring_file *const files){
+  const struct io_cqring_offsets *const off = &uring->params.cq_off;
+  unsigned int *const cq_head = head_uring_field(uring->cq_ring, off->head);
+  unsigned int *const cq_tail = head_uring_field(uring->cq_ring, off->tail);
+  const unsigned int cq_mask = *head_uring_field(uring->cq_ring,
+                                                 off->ring_mask);
+  struct io_uring_cqe *cqe;
+  struct head_uring_file *file;
+  unsigned int h;
+
+  h = *cq_head;
+  while(h != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)){
+    cqe = &uring->cqes[h & cq_mask];
+    file = &files[cqe->user_data & 0xff];
+    if((cqe->user_data & ~(__u64)0xff) == HEAD_URING_OPEN){
+      file->fd = cqe->res;
+      file->opened = true;
+      file->ready = cqe->res < 0;
+    }
+    else{
+      file->res = cqe->res;
+      file->ready = true;
+    }
+    uring->inflight -= 1;
+    h += 1;
+  }
+  __atomic_store_n(cq_head, h, __ATOMIC_RELEASE);
+}
+
+/**
+ * Wait until no submitted operation is in flight anymore, so that no read
+ * writes to a window after it got freed.
+ *
+ * @param[in,out] uring See @ref head_uring.
+ * @param[in,out] files Files of the current batch.
+ * @retval        0     No submitted operation in flight.
+ * @retval        -1    Failed to wait for the operations.
+ */
+static int
+head_uring_drain(struct head_uring *const uring,
+                 struct head_uring_file *const files){
+  while(uring->inflight > uring->queued){
+    if(head_uring_enter(uring, 0) < 0){
+      return -1;
+    }
+    head_uring_reap(uring, files);
+  }
+  return 0;
+}
+
+/**
+ * Check whether the first window of a file holds all the lines or bytes
+ * wanted, or the whole file.
+ *
+ * @param[in] head See @ref head.
+ * @param[in] file See @ref head_uring_file.
+ * @param[in] buf  Window read from the file.
+ * @retval    true  The window holds the whole head of the file.
+ * @retval    false More of the file needs to get read.
+ */
+static bool
+head_uring_whole(const struct head *const head,
+                 const struct head_uring_file *const file,
+                 const char *const buf){
+  uintmax_t remain;
+
+  if(file->res < HEAD_URING_WINDOW){
+    return true;
+  }
+  if(head->bytes){
+    return head->nbytes <= HEAD_URING_WINDOW;
+  }
+  remain = head->nlines;
+  head_scan(buf, HEAD_URING_WINDOW, head->delim, &remain);
+  return remain == 0;
+}
+
+/**
+ * Print the first window of a file read by @ref head_uring_run.
+ *
+ * Continues with @ref head_fd if the window did not contain all the lines
+ * or bytes wanted.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     file See @ref head_uring_file.
+ * @param[in]     buf  Window read from the file.
+ * @param[in]     path File path.
+ */
+static void
+head_uring_window(struct head *const head,
+                  const struct head_uring_file *const file,
+                  const char *const buf,
+                  const char *const path){
+  size_t len;
+
+  len = (size_t)file->res;
+#ifdef HEAD_ZLIB
+  if(head->decompress && head_gz_magic(buf, len)){
+    head_gz(head, file->fd, buf, len, path);
+    return;
+  }
+#endif /* HEAD_ZLIB */
+  len = head_take(head, buf, len);
+  if(head_write(head, buf, len) == 0 && head->remain > 0 && file->res > 0){
+    head_fd(head, file->fd, path);
+  }
+}
+
+/**
+ * Print and close a file opened and read by @ref head_uring_run.
+ *
+ * Regular files whose head does not fit in the first window get printed
+ * from the start by @ref head_path_fd instead, so that they take the same
+ * engines as when printed serially.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     file See @ref head_uring_file.
+ * @param[in]     buf  Window read from the file.
+ * @param[in]     path File path.
+ */
+static void
+head_uring_print(struct head *const head,
+                 const struct head_uring_file *const file,
+                 const char *const buf,
+                 const char *const path){
+  struct stat sb;
+
+  if(file->fd >= 0 && file->res >= 0 && !head_uring_whole(head, file, buf) &&
+     fstat(file->fd, &sb) == 0 && S_ISREG(sb.st_mode) &&
+     lseek(file->fd, 0, SEEK_SET) == 0){
+    head_path_fd(head, path, file->fd);
+    return;
+  }
+  head_stats_begin(head);
+  head_reset(head);
+  if(file->fd < 0){
+    errno = -file->fd;
+    head_warn(head, true, "open: %s", path);
+  }
+  else if(file->res < 0){
+    errno = -file->res;
+    head_warn(head, true, "read: %s", path);
+  }
+  else{
+    head_engine(head, HEAD_ENGINE_URING);
+    head->stats.nread += 1;
+    head->stats.bytes_read += (uintmax_t)file->res;
+    head_uring_window(head, file, buf, path);
+  }
+  if(file->fd >= 0 && close(file->fd) != 0){
+    head_warn(head, true, "close: %s", path);
+  }
+  head_flush(head);
+  head_stats_end(head, path);
+}
+
+/**
+ * Print multiple files using io_uring.
+ *
+ * Opens and reads the first window of up to @ref HEAD_URING_DEPTH files at
+ * once, queuing the read of each file as soon as its open completes. The
+ * files get printed in argument order as soon as all files before them
+ * have been printed. If the queues fail, the operations already submitted
+ * get waited for and the files not printed yet get printed by
+ * @ref head_serial, so only the files that fail themselves set an error
+ * status. Should even the wait fail, the windows get leaked rather than
+ * freed while the kernel may still write to them.
+ *
+ * @param[in,out] head   See @ref head.
+ * @param[in]     npaths Number of file operands in @p paths.
+ * @param[in]     paths  File operands.
+ * @retval        0      Printed all files.
+ * @retval        -1     io_uring not available, nothing printed.
+ */
+static int
+head_uring_run(struct head *const head,
+               const size_t npaths,
+               char **const paths){
+  struct head_uring uring;
+  struct head_uring_file files[HEAD_URING_DEPTH];
+  unsigned int k;
+  size_t base;
+  size_t n;
+  size_t next;
+  char *bufs;
+
+  if(head_uring_init(&uring) < 0){
+    return -1;
+  }
+  bufs = malloc(HEAD_URING_DEPTH * HEAD_URING_WINDOW);
+  if(bufs == NULL){
+    head_uring_free(&uring);
+    return -1;
+  }
+  n = 0;
+  next = 0;
+  for(base = 0; base < npaths; base += n){
+    n = npaths - base;
+    if(n > HEAD_URING_DEPTH){
+      n = HEAD_URING_DEPTH;
+    }
+    for(k = 0; k < n; k++){
+      memset(&files[k], 0, sizeof(files[k]));
+      head_uring_queue(&uring,
+                       IORING_OP_OPENAT,
+                       AT_FDCWD,
+                       paths[base + k],
+                       0,
+                       HEAD_URING_OPEN | k);
+    }
+    next = 0;
+    while(next < n){
+      if(head_uring_enter(&uring, uring.queued) < 0){
+        break;
+      }
+      head_uring_reap(&uring, files);
+      for(k = 0; k < n; k++){
+        if(files[k].opened && files[k].fd >= 0 && !files[k].reading){
+          head_uring_queue(&uring,
+                           IORING_OP_READ,
+                           files[k].fd,
+                           &bufs[k * HEAD_URING_WINDOW],
+                           HEAD_URING_WINDOW,
+                           HEAD_URING_READ | k);
+          files[k].reading = true;
+        }
+      }
+      for(; next < n && files[next].ready; next++){
+        head_banner(head,
+                    paths[base + next],
+                    head->nfiles + base + next == 0);
+        head_uring_print(head,
+                         &files[next],
+                         &bufs[next * HEAD_URING_WINDOW],
+                         paths[base + next]);
+      }
+    }
+    if(next < n){
+      break;
+    }
+  }
+  if(base < npaths){
+    if(head_uring_drain(&uring, files) < 0){
+      bufs = NULL;
+    }
+    for(k = (unsigned int)next; k < n; k++){
+      if(files[k].opened && files[k].fd >= 0){
+        close(files[k].fd);
+      }
+    }
+    base += next;
+  }
+  head_uring_free(&uring);
+  free(bufs);
+  head_serial(head, npaths, paths, base, true);
+  return 0;
+}
+#endif /* HEAD_URING */
+
+/**
+ * Print multiple files with the worker pool or through io_uring.
+ *
+ * The worker pool gets used if requested by (-j). Otherwise io_uring gets
+ * used for many file operands, unless holding back the last lines or
+ * serving a request, whose relative paths io_uring would not resolve
+ * against the working directory of the client. It also only gets used
+ * while the heads are expected to fit in its first window, assuming
+ * @ref HEAD_PREFETCH_LINE bytes per line: the window reads then serve as
+ * the read-ahead, while larger heads get read ahead by @ref head_serial.
+ * Files printed with (--resume) always take the serial path, which keeps
+ * the checkpoints.
+ *
+ * @param[in,out] head   See @ref head.
+ * @param[in]     npaths Number of file operands in @p paths.
+ * @param[in]     paths  File operands.
+ * @retval        true   Printed all files.
+ * @retval        false  Nothing printed, use the serial path.
+ */
+static bool
+head_batch(struct head *const head,
+           const size_t npaths,
+           char **const paths){
+  if(head->resume){
+    return false;
+  }
+  if(head->jobs > 1){
+    return head_pool_run(head, npaths, paths) == 0;
+  }
+#ifdef HEAD_URING
+  if(npaths >= HEAD_URING_MIN_FILES && !head->elide && head->cache == NULL &&
+     (head->bytes ? head->nbytes <= HEAD_URING_WINDOW :
+                    head->nlines <= HEAD_URING_WINDOW / HEAD_PREFETCH_LINE)){
+    return head_uring_run(head, npaths, paths) == 0;
+  }
+#endif /* HEAD_URING */
+  return false;
+}
+
+/**
+ * Print a batch of files, with a banner in front of each one if requested.
+ *
+ * @param[in,out] head   See @ref head.
+ * @param[in]     npaths Number of file operands in @p paths.
+ * @param[in]     paths  File operands.
+ * @param[in]     banner Print a banner in front of each file.
+ */
+static void
+head_files(struct head *const head,
+           const size_t npaths,
+           char **const paths,
+           const bool banner){
+  if(!banner || !head_batch(head, npaths, paths)){
+    head_serial(head, npaths, paths, 0, banner);
+  }
+  head->nfiles += npaths;
+}
+
+/**
+ * Print the files listed in a file.
+ *
+ * Corresponds to the (--files-from) and (--files0-from) arguments.
+ *
+ * The list gets read as a stream in batches of @ref HEAD_FILES_BATCH
+ * paths, each printed by @ref head_files, so memory use does not grow
+ * with the length of the list. Banners get printed exactly as for file
+ * operands, which means only if the list holds more than one path.
+ *
+ * @param[in,out] head  See @ref head.
+ * @param[in]     list  File holding the list, or "-" for @ref head::in.
+ * @param[in]     delim Byte ending each path in the list.
+ */
+static void
+head_files_from(struct head *const head,
+                const char *const list,
+                const int delim){
+  char *paths[HEAD_FILES_BATCH];
+  char *path;
+  size_t cap;
+  size_t npaths;
+  size_t i;
+  ssize_t len;
+  FILE *fp;
+  int fd;
+
+  if(strcmp(list, "-") == 0){
+    fd = dup(head->in);
+    fp = (fd < 0) ? NULL : fdopen(fd, "r");
+    if(fp == NULL && fd >= 0){
+      close(fd);
+    }
+  }
+  else{
+    fp = fopen(list, "r");
+  }
+  if(fp == NULL){
+    head_warn(head, true, "open: %s", list);
+    return;
+  }
+  do{
+    npaths = 0;
+    while(npaths < HEAD_FILES_BATCH){
+      path = NULL;
+      cap = 0;
+      len = getdelim(&path, &cap, delim, fp);
+      if(len < 0){
+        free(path);
+        break;
+      }
+      if(path[len - 1] == delim){
+        path[--len] = '\0';
+      }
+      if(len == 0){
+        head_warn(head, false, "%s: invalid zero-length file name", list);
+        free(path);
+      }
+      else{
+        paths[npaths++] = path;
+      }
+    }
+    head_files(head,
+               npaths,
+               paths,
+               head->nfiles > 0 || npaths > 1);
+    for(i = 0; i < npaths; i++){
+      free(paths[i]);
+    }
+  } while(npaths == HEAD_FILES_BATCH);
+  if(ferror(fp)){
+    head_warn(head, true, "read: %s", list);
+  }
+  fclose(fp);
+}
+
+/**
+ * Parse a number of threads.
+ *
+ * Corresponds to the (-j) and (--scan-threads) arguments.
+ *
+ * @param[in,out] head    See @ref head.
+ * @param[in]     s       String to parse.
+ * @param[out]    threads Parsed number of threads.
+ * @param[in]     what    Name of the threads used in error messages.
+ */
+static void
+head_parse_jobs(struct head *const head,
+                const char *const s,
+                size_t *const threads,
+                const char *const what){
+  unsigned long jobs;
+  char *ep;
+
+  errno = 0;
+  jobs = strtoul(s, &ep, 10);
+  if(s[0] < '0' || s[0] > '9' || *ep != '\0' ||
+     jobs < 1 || jobs > HEAD_JOBS_MAX){
+    head_warn(head, false, "invalid number of %s: %s", what, s);
+  }
+  else{
+    *threads = jobs;
+  }
+}
+
+/**
+ * Parse the byte ending each line.
+ *
+ * Corresponds to the (-d) argument. An empty argument selects the NUL byte,
+ * like the (-z) argument.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     s    String to parse.
+ */
+static void
+head_parse_delim(struct head *const head,
+                 const char *const s){
+  if(s[0] != '\0' && s[1] != '\0'){
+    head_warn(head, false, "delimiter must be a single byte: %s", s);
+  }
+  else{
+    head->delim = s[0];
+  }
+}
+
+/**
+ * Parse number of lines or bytes to print.
+ *
+ * Corresponds to the (-n) and (-c) arguments. A leading '-' selects all but
+ * the last lines or bytes, see @ref head::elide, and a leading '+' gets
+ * ignored.
+ *
+ * @param[in,out] head  See @ref head.
+ * @param[in]     s     String to parse.
+ * @param[out]    count Parsed number.
+ */
+static void
+head_parse_count(struct head *const head,
+                 const char *const s,
+                 uintmax_t *const count){
+  const char *num;
+  char *ep;
+
+  num = s;
+  head->elide = (s[0] == '-');
+  if(head->elide || s[0] == '+'){
+    num += 1;
+  }
+  errno = 0;
+  *count = strtoumax(num, &ep, 10);
+  if(num[0] < '0' || num[0] > '9' || *ep != '\0'){
+    head_warn(head, false, "not a number: %s", s);
+  }
+  else if(*count == UINTMAX_MAX && errno == ERANGE){
+    head_warn(head, true, "out of range: %s", s);
+  }
+  else if(head->elide && *count == 0){
+    head->elide = false;
+    *count = UINTMAX_MAX;
+  }
+}
+
+/**
+ * Get the result of a library call and clear the status for the next one.
+ *
+ * @param[in,out] head See @ref head.
+ * @retval        0    No error occurred.
+ * @retval        -1   Error occurred.
+ */
+static int
+head_result(struct head *const head){
+  const int status_code = head->status_code;
+
+  head->status_code = EXIT_SUCCESS;
+  return status_code == EXIT_SUCCESS ? 0 : -1;
+}
+
+/**
+ * Create a head context.
+ *
+ * The context prints the first @ref HEAD_DEFAULT_LINES lines to STDOUT
+ * until changed by @ref head_set_lines, @ref head_set_bytes or
+ * @ref head_set_sink.
+ *
+ * @return New context to free with @ref head_free, or NULL if out of
+ *         memory.
+ */
+struct head *
+head_new(void){
+  struct head *head;
+
+  head_scan_init();
+  head = malloc(sizeof(*head));
+  if(head){
+    memset(head, 0, sizeof(*head));
+    head->in = STDIN_FILENO;
+    head->out = STDOUT_FILENO;
+    head->err = STDERR_FILENO;
+    head_copy_init(head);
+    head->nlines = HEAD_DEFAULT_LINES;
+    head->jobs = 1;
+    head->scan_threads = 1;
+    head->delim = '\n';
+  }
+  return head;
+}
+
+/**
+ * Free a head context and its buffers.
+ *
+ * @param[in] head Context created by @ref head_new, or NULL.
+ */
+void
+head_free(struct head *head){
+  if(head){
+    free(head->buf);
+    free(head->hdr.data);
+    free(head);
+  }
+}
+
+/**
+ * Print the first lines of each input.
+ *
+ * Holding back no line prints every line, as for (-n -0).
+ *
+ * @param[in,out] head   See @ref head.
+ * @param[in]     nlines Number of lines.
+ * @param[in]     elide  Print all but the last @p nlines lines instead.
+ */
+void
+head_set_lines(struct head *head,
+               uintmax_t nlines,
+               bool elide){
+  head->nlines = (elide && nlines == 0) ? UINTMAX_MAX : nlines;
+  head->bytes = false;
+  head->elide = elide && nlines > 0;
+}
+
+/**
+ * Print the first bytes of each input.
+ *
+ * Holding back no byte prints every byte, as for (-c -0).
+ *
+ * @param[in,out] head   See @ref head.
+ * @param[in]     nbytes Number of bytes.
+ * @param[in]     elide  Print all but the last @p nbytes bytes instead.
+ */
+void
+head_set_bytes(struct head *head,
+               uintmax_t nbytes,
+               bool elide){
+  head->nbytes = (elide && nbytes == 0) ? UINTMAX_MAX : nbytes;
+  head->bytes = true;
+  head->elide = elide && nbytes > 0;
+}
+
+/**
+ * End each line with another byte than a newline.
+ *
+ * @param[in,out] head  See @ref head.
+ * @param[in]     delim Byte ending each line, such as the NUL byte.
+ */
+void
+head_set_delim(struct head *head,
+               int delim){
+  head->delim = (char)delim;
+}
+
+/**
+ * Pass the printed bytes to a callback instead of writing them to STDOUT.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     sink Output callback, or NULL to write to STDOUT.
+ * @param[in]     arg  Argument passed to @p sink.
+ */
+void
+head_set_sink(struct head *head,
+              head_sink_fn sink,
+              void *arg){
+  head->sink = sink;
+  head->sink_arg = arg;
+  if(sink){
+    head->copy = HEAD_COPY_NONE;
+  }
+  else{
+    head_copy_init(head);
+  }
+}
+
+/**
+ * Output callback filling a caller-supplied buffer.
+ *
+ * Bytes that do not fit get dropped.
+ *
+ * @param[in,out] arg Output buffer, see @ref head_buf.
+ * @param[in]     buf Printed bytes.
+ * @param[in]     len Number of bytes in @p buf.
+ * @retval        0   Buffer held all bytes.
+ * @retval        -1  Buffer full, errno set to ENOBUFS.
+ */
+int
+head_sink_buf(void *arg,
+              const char *buf,
+              size_t len){
+  struct head_buf *const hbuf = arg;
+  size_t n;
+
+  n = hbuf->size - hbuf->len;
+  if(n > len){
+    n = len;
+  }
+  memcpy(hbuf->data + hbuf->len, buf, n);
+  hbuf->len += n;
+  if(n < len){
+    errno = ENOBUFS;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Print the head of the input read from a file descriptor.
+ *
+ * Reads from the current file offset of @p fd.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fd   File descriptor to read from.
+ * @param[in]     name Input name used in error messages.
+ * @retval        0    Printed the head of the input.
+ * @retval        -1   Error occurred.
+ */
+int
+head_print_fd(struct head *head,
+              int fd,
+              const char *name){
+  head_reset(head);
+  head_stream(head, fd, name);
+  return head_result(head);
+}
+
+/**
+ * Print all but the last lines or bytes of a buffer.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     buf  Input bytes.
+ * @param[in]     len  Number of bytes in @p buf.
  */
-# define LINKAGE extern
-# include "../test/seams.h"
-#else /* !(TEST) */
+static void
+head_elide_mem(struct head *const head,
+               const char *const buf,
+               const size_t len){
+  size_t end;
+  size_t cut;
+
+  cut = 0;
+  if(head->bytes){
+    if(head->remain < len){
+      cut = len - (size_t)head->remain;
+    }
+  }
+  else{
+    /*
+     * The newline ending the last line does not start another line.
+     */
+    end = len;
+    if(end > 0 && buf[end - 1] == head->delim){
+      end -= 1;
+    }
+    cut = head_rscan(buf, end, head->delim, &head->remain);
+    if(head->remain > 0){
+      cut = 0;
+    }
+  }
+  head_write(head, buf, cut);
+}
+
 /**
- * Define all functions as static when not testing.
+ * Print the head of the input read from a stdio stream.
+ *
+ * When done with a seekable stream in line mode, the stream gets
+ * positioned right after the printed lines. Printing all but the last
+ * lines or bytes collects the whole stream in memory.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     fp   Stream to read from.
+ * @param[in]     name Input name used in error messages.
+ * @retval        0    Printed the head of the input.
+ * @retval        -1   Error occurred.
  */
-# define LINKAGE static
-#endif /* TEST */
+int
+head_print_fp(struct head *head,
+              FILE *fp,
+              const char *name){
+  struct head_obuf in;
+  size_t nread;
+  size_t len;
+
+  head_reset(head);
+  if(head->buf == NULL){
+    head->buf = malloc(HEAD_BLOCK_SIZE);
+    if(head->buf == NULL){
+      head_warn(head, true, "malloc");
+      return head_result(head);
+    }
+  }
+  memset(&in, 0, sizeof(in));
+  while(head->elide || head->remain > 0){
+    len = HEAD_BLOCK_SIZE;
+    if(!head->elide && head->bytes && head->remain < len){
+      len = (size_t)head->remain;
+    }
+    nread = fread(head->buf, 1, len, fp);
+    if(nread == 0){
+      if(ferror(fp)){
+        head_warn(head, true, "read: %s", name);
+      }
+      break;
+    }
+    if(head->elide){
+      if(head_append(head, &in, head->buf, nread) < 0){
+        break;
+      }
+      continue;
+    }
+    len = head_take(head, head->buf, nread);
+    if(head_write(head, head->buf, len) < 0){
+      break;
+    }
+    if(len < nread){
+      fseeko(fp, (off_t)len - (off_t)nread, SEEK_CUR);
+    }
+  }
+  if(head->elide && head->status_code == EXIT_SUCCESS){
+    head_elide_mem(head, in.data, in.len);
+  }
+  free(in.data);
+  return head_result(head);
+}
 
 /**
- * Default number of lines to print if -n argument unspecified.
+ * Print the head of a memory buffer.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     buf  Input bytes.
+ * @param[in]     len  Number of bytes in @p buf.
+ * @retval        0    Printed the head of the input.
+ * @retval        -1   Error occurred.
  */
-#define HEAD_DEFAULT_LINES (10)
+int
+head_print_mem(struct head *head,
+               const void *buf,
+               size_t len){
+  head_reset(head);
+  if(head->elide){
+    head_elide_mem(head, buf, len);
+  }
+  else{
+    head_write(head, buf, head_take(head, buf, len));
+  }
+  return head_result(head);
+}
 
 /**
- * Head utility context.
+ * Print the head of a file.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     path File path.
+ * @retval        0    Printed the head of the file.
+ * @retval        -1   Error occurred.
  */
-struct head{
+int
+head_print_path(struct head *head,
+                const char *path){
+  head_path(head, path);
+  return head_result(head);
+}
+
+/**
+ * Arguments of the head program not stored in @ref head.
+ */
+struct head_args{
   /**
-   * Exit status set to one of the following values.
-   *   - EXIT_SUCCESS
-   *   - EXIT_FAILURE
+   * File descriptor receiving the (--stats) report, or NULL.
    */
-  int status_code;
+  const char *stats;
 
   /**
-   * Padding for alignment.
+   * File holding the (--files-from) or (--files0-from) list, or NULL.
    */
-  char pad[4];
+  const char *files_from;
 
   /**
-   * Number of initial lines to write in each file.
-   *
-   * Corresponds to the (-n) argument.
+   * Socket path of the (--serve) argument, or NULL.
    */
-  uintmax_t nlines;
+  const char *serve;
 
   /**
-   * getline() line buffer.
+   * Socket path of the (--client) argument, or NULL.
    */
-  char *line;
+  const char *client;
+
+  /**
+   * State file of the (--resume) argument, or NULL.
+   */
+  const char *resume;
+
+  /**
+   * File operands.
+   */
+  char **operands;
+
+  /**
+   * Number of file operands in @ref operands.
+   */
+  int noperands;
 
   /**
-   * Number of bytes allocated in @ref line.
+   * Byte ending each path in the @ref files_from list.
    */
-  size_t linesize;
+  int files_delim;
 };
 
 /**
- * Print an error message to STDERR and set an error status code.
+ * Serializes getopt_long(), which keeps its state in global variables,
+ * between threads serving requests.
+ */
+static pthread_mutex_t head_getopt_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Get the number of online processors.
  *
- * @param[in,out] head      See @ref head.
- * @param[in]     errno_msg Include a standard message describing errno.
- * @param[in]     fmt       Format string used by vwarn.
+ * @return Number of processors, between 1 and @ref HEAD_JOBS_MAX.
+ */
+static size_t
+head_nprocs(void){
+  long nprocs;
+
+  nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+  if(nprocs < 1){
+    nprocs = 1;
+  }
+  else if(nprocs > HEAD_JOBS_MAX){
+    nprocs = HEAD_JOBS_MAX;
+  }
+  return (size_t)nprocs;
+}
+
+/**
+ * Initialize a context with the defaults of the head program.
+ *
+ * @param[out] head See @ref head.
+ * @param[in]  in   See @ref head::in.
+ * @param[in]  out  See @ref head::out.
+ * @param[in]  err  See @ref head::err.
  */
 static void
-head_warn(struct head *const head,
-          const bool errno_msg,
-          const char *const fmt, ...){
-  va_list ap;
+head_init(struct head *const head,
+          const int in,
+          const int out,
+          const int err){
+  memset(head, 0, sizeof(*head));
+  head->in = in;
+  head->out = out;
+  head->err = err;
+  head_copy_init(head);
+  head->nlines = HEAD_DEFAULT_LINES;
+  head->scan_threads = head_nprocs();
+  head->delim = '\n';
+}
 
-  head->status_code = EXIT_FAILURE;
-  va_start(ap, fmt);
-  if(errno_msg){
-    vwarn(fmt, ap);
+/**
+ * Parse the arguments of the head program.
+ *
+ * Sets @ref head::jobs to 0 unless given by (-j), so the caller can pick
+ * the default.
+ *
+ * @param[in,out] head See @ref head.
+ * @param[in]     argc Number of arguments in @p argv.
+ * @param[in,out] argv Argument list, reordered by getopt_long().
+ * @param[out]    args See @ref head_args.
+ */
+static void
+head_parse_args(struct head *const head,
+                int argc,
+                char *argv[],
+                struct head_args *const args){
+  const struct option longopts[] = {
+    {"client",       required_argument, NULL, HEAD_OPT_CLIENT},
+    {"decompress",   no_argument,       NULL, HEAD_OPT_DECOMPRESS},
+    {"files-from",   required_argument, NULL, HEAD_OPT_FILES_FROM},
+    {"files0-from",  required_argument, NULL, HEAD_OPT_FILES0_FROM},
+    {"index-dir",    required_argument, NULL, HEAD_OPT_INDEX_DIR},
+    {"resume",       required_argument, NULL, HEAD_OPT_RESUME},
+    {"scan-threads", required_argument, NULL, HEAD_OPT_SCAN_THREADS},
+    {"serve",        required_argument, NULL, HEAD_OPT_SERVE},
+    {"stats",        optional_argument, NULL, HEAD_OPT_STATS},
+    {NULL,           0,                 NULL, 0}
+  };
+  int c;
+
+  memset(args, 0, sizeof(*args));
+  args->files_delim = '\n';
+  pthread_mutex_lock(&head_getopt_mutex);
+  optind = 0;
+  opterr = (head->err == STDERR_FILENO);
+  while((c = getopt_long(argc, argv, "c:d:j:n:z", longopts, NULL)) != -1){
+    switch(c){
+      case 'c':
+        head_parse_count(head, optarg, &head->nbytes);
+        head->bytes = true;
+        break;
+      case 'd':
+        head_parse_delim(head, optarg);
+        break;
+      case 'j':
+        head_parse_jobs(head, optarg, &head->jobs, "jobs");
+        break;
+      case 'n':
+        head_parse_count(head, optarg, &head->nlines);
+        head->bytes = false;
+        break;
+      case 'z':
+        head->delim = '\0';
+        break;
+      case HEAD_OPT_INDEX_DIR:
+        head->index_dir = optarg;
+        break;
+      case HEAD_OPT_STATS:
+        args->stats = optarg ? optarg : "2";
+        break;
+      case HEAD_OPT_FILES_FROM:
+      case HEAD_OPT_FILES0_FROM:
+        args->files_from = optarg;
+        args->files_delim = (c == HEAD_OPT_FILES0_FROM) ? '\0' : '\n';
+        break;
+      case HEAD_OPT_SCAN_THREADS:
+        head_parse_jobs(head, optarg, &head->scan_threads, "scan threads");
+        break;
+      case HEAD_OPT_SERVE:
+        args->serve = optarg;
+        break;
+      case HEAD_OPT_CLIENT:
+        args->client = optarg;
+        break;
+      case HEAD_OPT_RESUME:
+        args->resume = optarg;
+        break;
+      case HEAD_OPT_DECOMPRESS:
+#ifdef HEAD_ZLIB
+        head->decompress = true;
+#else
+        head_warn(head, false, "--decompress: built without zlib");
+#endif /* HEAD_ZLIB */
+        break;
+      default:
+        if(!opterr){
+          head_warn(head, false, "invalid option: %s", argv[optind - 1]);
+        }
+        head->status_code = EXIT_FAILURE;
+        break;
+    }
   }
-  else{
-    vwarnx(fmt, ap);
+  args->operands = argv + optind;
+  args->noperands = argc - optind;
+  pthread_mutex_unlock(&head_getopt_mutex);
+
+  if(args->files_from && args->noperands > 0){
+    head_warn(head,
+              false,
+              "extra operand %s, file operands cannot be combined with "
+              "--files-from",
+              args->operands[0]);
   }
-  va_end(ap);
 }
 
 /**
- * Print head lines from file pointer.
+ * Print the head of the files given by the arguments of the head program.
  *
  * @param[in,out] head See @ref head.
- * @param[in,out] fp   File pointer to read from.
+ * @param[in]     args See @ref head_args.
  */
 static void
-head_fp(struct head *const head,
-        FILE *fp){
-  uintmax_t i;
-  ssize_t linelen;
-  size_t nmemb;
+head_exec(struct head *const head,
+          const struct head_args *const args){
+  struct head_resume resume;
+
+  if(head->jobs == 0){
+    head->jobs = 1;
+  }
+  if(head->status_code == 0 && args->resume){
+    if(head->bytes || head->elide){
+      head_warn(head, false, "--resume needs a positive number of lines");
+    }
+    else if(head_resume_load(head, &resume, args->resume) == 0){
+      head->resume = &resume;
+    }
+  }
+  if(head->status_code == 0 && args->stats){
+    head_stats_open(head, args->stats);
+  }
+  if(head->status_code == 0){
+    if(args->files_from){
+      head_files_from(head, args->files_from, args->files_delim);
+    }
+    else if(args->noperands < 1){
+      head_stats_begin(head);
+      head_reset(head);
+      head_stream(head, head->in, "stdin");
+      head_stats_end(head, "stdin");
+    }
+    else{
+      head_files(head,
+                 (size_t)args->noperands,
+                 args->operands,
+                 args->noperands > 1);
+    }
+    if(head->stats_fp){
+      head_stats_close(head);
+    }
+  }
+  if(head->resume){
+    head_resume_save(head);
+    head_resume_free(head->resume);
+    head->resume = NULL;
+  }
+  free(head->buf);
+  free(head->hdr.data);
+}
+
+/**
+ * State shared by the threads of (--serve).
+ */
+struct head_server{
+  /**
+   * See @ref head_cache.
+   */
+  struct head_cache cache;
+
+  /**
+   * Listening socket.
+   */
+  int sock;
+
+  /**
+   * Set when shutting down, read with atomic loads.
+   */
+  int stop;
+};
+
+/**
+ * Check that the peer of a connection runs as the same user as the server.
+ *
+ * @param[in] conn Connected socket.
+ * @retval    true  Peer runs as the same user.
+ * @retval    false Peer runs as another user, or its credentials could not
+ *                  get read.
+ */
+static bool
+head_serve_peer(const int conn){
+  struct ucred cred;
+  socklen_t len;
+
+  len = sizeof(cred);
+  return getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 &&
+         cred.uid == getuid();
+}
+
+/**
+ * Handle a single request sent to (--serve).
+ *
+ * A request holds the arguments of the head program, each ending with a
+ * NUL byte, together with the file descriptors in @ref head_serve_fd
+ * passed as SCM_RIGHTS. The request gets printed straight to the STDOUT of
+ * the client, so the kernel copy methods apply, and its exit status gets
+ * sent back as an int once done.
+ *
+ * @param[in,out] srv  See @ref head_server.
+ * @param[in]     conn Connected socket.
+ * @param[out]    msg  Buffer of @ref HEAD_SERVE_MSG_MAX bytes.
+ * @retval        0    Handled the request.
+ * @retval        -1   Connection closed, timed out or failed.
+ */
+static int
+head_serve_request(struct head_server *const srv,
+                   const int conn,
+                   char *const msg){
+  union{
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(int) * HEAD_SERVE_NFDS)];
+  } ctl;
+  int fds[HEAD_SERVE_NFDS];
+  struct head_args args;
+  struct head head;
+  struct msghdr mh;
+  struct cmsghdr *cm;
+  struct iovec iov;
+  char **argv;
+  ssize_t len;
+  size_t nfds;
+  size_t i;
+  int argc;
+  int status;
+
+  iov.iov_base = msg;
+  iov.iov_len = HEAD_SERVE_MSG_MAX;
+  memset(&mh, 0, sizeof(mh));
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = ctl.buf;
+  mh.msg_controllen = sizeof(ctl.buf);
+  len = recvmsg(conn, &mh, MSG_CMSG_CLOEXEC);
+  if(len <= 0){
+    return -1;
+  }
+  nfds = 0;
+  cm = CMSG_FIRSTHDR(&mh);
+  if(cm && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS){
+    nfds = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    memcpy(fds, CMSG_DATA(cm), nfds * sizeof(int));
+  }
+
+  status = EXIT_FAILURE;
+  argv = NULL;
+  if(nfds == HEAD_SERVE_NFDS && msg[len - 1] == '\0' &&
+     (mh.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) == 0){
+    argc = 1;
+    for(i = 0; i < (size_t)len; i++){
+      argc += (msg[i] == '\0');
+    }
+    argv = malloc(((size_t)argc + 1) * sizeof(*argv));
+  }
+  if(argv && fchdir(fds[HEAD_SERVE_FD_CWD]) == 0){
+    argv[0] = program_invocation_short_name;
+    argc = 1;
+    for(i = 0; i < (size_t)len; i += strlen(msg + i) + 1){
+      argv[argc++] = msg + i;
+    }
+    argv[argc] = NULL;
+    head_init(&head,
+              fds[HEAD_SERVE_FD_IN],
+              fds[HEAD_SERVE_FD_OUT],
+              fds[HEAD_SERVE_FD_ERR]);
+    head.cache = &srv->cache;
+    head_parse_args(&head, argc, argv, &args);
+    if(args.serve){
+      head_warn(&head, false, "--serve: not allowed in a request");
+    }
+    if(args.client){
+      head_warn(&head, false, "--client: not allowed in a request");
+    }
+    head_exec(&head, &args);
+    status = head.status_code;
+  }
+  free(argv);
+  for(i = 0; i < nfds; i++){
+    close(fds[i]);
+  }
+  if(send(conn, &status, sizeof(status), MSG_NOSIGNAL) != sizeof(status)){
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Worker thread of (--serve) accepting connections and handling their
+ * requests one after another.
+ *
+ * Each worker gets its own working directory, so that relative paths in a
+ * request resolve against the working directory of the client. Connections
+ * from other users get closed without reading a request, see
+ * @ref head_serve_peer.
+ *
+ * @param[in,out] arg See @ref head_server.
+ * @return            Always NULL.
+ */
+static void *
+head_serve_worker(void *arg){
+  struct head_server *const srv = arg;
+  struct timeval tv;
+  char *msg;
+  int conn;
 
-  for(i = 0; i < head->nlines; i++){
-    errno = 0;
-    linelen = getline(&head->line, &head->linesize, fp);
-    if(linelen < 0){
-      if(errno != 0){
-        head_warn(head, true, "getline");
+  msg = malloc(HEAD_SERVE_MSG_MAX);
+  if(msg == NULL || unshare(CLONE_FS) != 0){
+    free(msg);
+    kill(getpid(), SIGTERM);
+    return NULL;
+  }
+  tv.tv_sec = HEAD_SERVE_TIMEOUT;
+  tv.tv_usec = 0;
+  while(!__atomic_load_n(&srv->stop, __ATOMIC_ACQUIRE)){
+    conn = accept4(srv->sock, NULL, NULL, SOCK_CLOEXEC);
+    if(conn < 0){
+      if(errno == EINTR || errno == ECONNABORTED){
+        continue;
       }
       break;
     }
-    /* linelen >= 0 */
-    nmemb = (size_t)linelen;
-    if(fwrite(head->line, sizeof(*head->line), nmemb, stdout) != nmemb){
-      head_warn(head, true, "fwrite: %s", &head->line);
-      break;
+    if(!head_serve_peer(conn)){
+      close(conn);
+      continue;
     }
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    while(!__atomic_load_n(&srv->stop, __ATOMIC_ACQUIRE) &&
+          head_serve_request(srv, conn, msg) == 0);
+    close(conn);
   }
-  if(ferror(fp) || ferror(stdout)){
-    head_warn(head, true, "ferror: file error indicator set");
-  }
+  free(msg);
+  return NULL;
 }
 
 /**
- * Open a file path and call @ref head_fp.
+ * Serve requests of (--client) over a Unix domain socket until receiving
+ * SIGINT, SIGTERM or SIGHUP.
+ *
+ * Corresponds to the (--serve) argument.
+ *
+ * Requests get handled by @ref head::jobs worker threads, see
+ * @ref head_serve_request. Regular files stay open between requests in a
+ * @ref head_cache together with their line-offset index, which gets built
+ * in memory even without (--index-dir). The socket gets created with mode
+ * 0600, so that only the user running the server can connect to it.
  *
  * @param[in,out] head See @ref head.
- * @param[in]     path File path.
+ * @param[in]     path Socket path, replaced if a stale socket exists.
  */
 static void
-head_path(struct head *const head,
-          const char *const path){
-  FILE *fp;
+head_serve(struct head *const head,
+           const char *const path){
+  struct head_server *srv;
+  struct sockaddr_un addr;
+  struct stat sb;
+  pthread_t *threads;
+  sigset_t set;
+  size_t nthreads;
+  size_t i;
+  mode_t mask;
+  bool bound;
+  int sig;
 
-  fp = fopen(path, "r");
-  if(fp == NULL){
-    head_warn(head, true, "fopen: %s", path);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(strlen(path) >= sizeof(addr.sun_path)){
+    head_warn(head, false, "socket path too long: %s", path);
+    return;
+  }
+  strcpy(addr.sun_path, path);
+  srv = malloc(sizeof(*srv));
+  threads = malloc(head->jobs * sizeof(*threads));
+  if(srv == NULL || threads == NULL){
+    head_warn(head, true, "malloc");
+    free(srv);
+    free(threads);
+    return;
+  }
+  memset(srv, 0, sizeof(*srv));
+  for(i = 0; i < HEAD_CACHE_SIZE; i++){
+    srv->cache.ent[i].fd = -1;
+  }
+  pthread_mutex_init(&srv->cache.mutex, NULL);
+  if(lstat(path, &sb) == 0 && S_ISSOCK(sb.st_mode)){
+    unlink(path);
+  }
+  srv->sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  mask = umask(S_IXUSR | S_IRWXG | S_IRWXO);
+  bound = (srv->sock >= 0 &&
+           bind(srv->sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+  umask(mask);
+  if(!bound || listen(srv->sock, SOMAXCONN) != 0){
+    head_warn(head, true, "serve: %s", path);
+    nthreads = 0;
   }
   else{
-    head_fp(head, fp);
-    if(fclose(fp) != 0){
-      head_warn(head, true, "fclose: %s", path);
+    sigemptyset(&set);
+    sigaddset(&set, SIGHUP);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    sigdelset(&set, SIGPIPE);
+    for(nthreads = 0; nthreads < head->jobs; nthreads++){
+      if(pthread_create(&threads[nthreads],
+                        NULL,
+                        head_serve_worker,
+                        srv) != 0){
+        break;
+      }
+    }
+    if(nthreads == 0){
+      head_warn(head, true, "pthread_create");
+    }
+    else{
+      sigwait(&set, &sig);
     }
+    __atomic_store_n(&srv->stop, 1, __ATOMIC_RELEASE);
+    shutdown(srv->sock, SHUT_RDWR);
+    while(nthreads > 0){
+      nthreads -= 1;
+      pthread_join(threads[nthreads], NULL);
+    }
+    unlink(path);
+  }
+  if(srv->sock >= 0){
+    close(srv->sock);
+  }
+  for(i = 0; i < HEAD_CACHE_SIZE; i++){
+    if(srv->cache.ent[i].fd >= 0){
+      close(srv->cache.ent[i].fd);
+    }
+    free(srv->cache.ent[i].idx.off);
   }
+  pthread_mutex_destroy(&srv->cache.mutex);
+  free(srv);
+  free(threads);
 }
 
 /**
- * Parse number of lines to print.
+ * Send the arguments of the head program to (--serve) and wait for the
+ * request to finish.
  *
- * Corresponds to the (-n) argument.
+ * Corresponds to the (--client) argument.
+ *
+ * The server prints straight to STDOUT and STDERR of the client, and reads
+ * STDIN of the client if no file operand is given. The (--client) argument
+ * itself does not get sent, recognized by @p path pointing into it.
  *
  * @param[in,out] head See @ref head.
- * @param[in]     s    String to parse.
+ * @param[in]     path Socket path, the argument of (--client) in @p argv.
+ * @param[in]     argc Number of arguments in @p argv.
+ * @param[in]     argv Arguments sent to the server, reordered by
+ *                     getopt_long().
  */
 static void
-head_parse_nlines(struct head *const head,
-                  const char *const s){
-  char *ep;
+head_client(struct head *const head,
+            const char *const path,
+            const int argc,
+            char *const argv[]){
+  union{
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(int) * HEAD_SERVE_NFDS)];
+  } ctl;
+  int fds[HEAD_SERVE_NFDS];
+  struct sockaddr_un addr;
+  struct msghdr mh;
+  struct cmsghdr *cm;
+  struct iovec iov;
+  const char *eq;
+  char *msg;
+  size_t len;
+  size_t arglen;
+  ssize_t nread;
+  int status;
+  int sock;
+  int i;
 
-  errno = 0;
-  head->nlines = strtoumax(s, &ep, 10);
-  if(s[0] == '\0' || *ep != '\0'){
-    head_warn(head, false, "not a number: %s", s);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(strlen(path) >= sizeof(addr.sun_path)){
+    head_warn(head, false, "socket path too long: %s", path);
+    return;
   }
-  else if(head->nlines == UINTMAX_MAX && errno == ERANGE){
-    head_warn(head, true, "out of range: %s", s);
+  strcpy(addr.sun_path, path);
+  msg = malloc(HEAD_SERVE_MSG_MAX);
+  if(msg == NULL){
+    head_warn(head, true, "malloc");
+    return;
+  }
+  len = 0;
+  for(i = 0; i < argc; i++){
+    eq = strchr(argv[i], '=');
+    if(argv[i] == path ||
+       (i + 1 < argc && argv[i + 1] == path) ||
+       (eq && eq + 1 == path)){
+      continue;
+    }
+    arglen = strlen(argv[i]) + 1;
+    if(arglen > HEAD_SERVE_MSG_MAX - len){
+      head_warn(head, false, "request too long, use --files-from");
+      free(msg);
+      return;
+    }
+    memcpy(msg + len, argv[i], arglen);
+    len += arglen;
+  }
+
+  fds[HEAD_SERVE_FD_IN] = head->in;
+  fds[HEAD_SERVE_FD_OUT] = head->out;
+  fds[HEAD_SERVE_FD_ERR] = head->err;
+  fds[HEAD_SERVE_FD_CWD] = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  iov.iov_base = msg;
+  iov.iov_len = len;
+  memset(&mh, 0, sizeof(mh));
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = ctl.buf;
+  mh.msg_controllen = sizeof(ctl.buf);
+  cm = CMSG_FIRSTHDR(&mh);
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+  sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if(fds[HEAD_SERVE_FD_CWD] < 0){
+    head_warn(head, true, "open: .");
+  }
+  else if(sock < 0 ||
+          connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+          sendmsg(sock, &mh, MSG_NOSIGNAL) != (ssize_t)len){
+    head_warn(head, true, "client: %s", path);
+  }
+  else{
+    nread = recv(sock, &status, sizeof(status), 0);
+    if(nread != sizeof(status)){
+      head_warn(head, false, "client: %s: no reply from server", path);
+    }
+    else if(status != EXIT_SUCCESS){
+      head->status_code = EXIT_FAILURE;
+    }
+  }
+  if(sock >= 0){
+    close(sock);
+  }
+  if(fds[HEAD_SERVE_FD_CWD] >= 0){
+    close(fds[HEAD_SERVE_FD_CWD]);
   }
+  free(msg);
 }
 
 /**
  * Main entry point for head program.
  *
  * Usage:
- * head [-n number] [file...]
+ * head [-c [-]number | -n [-]number] [-d delim | -z] [-j jobs]
+ *      [--decompress] [--index-dir=dir] [--resume=state]
+ *      [--scan-threads=n] [--stats[=fd]]
+ *      [--files-from=list | --files0-from=list | file...]
+ * head [-j jobs] --serve=socket
+ * head --client=socket [argument...]
  *
  * @param[in]     argc         Number of arguments in @p argv.
  * @param[in,out] argv         Argument list.
  * @retval        EXIT_SUCCESS Successful.
  * @retval        EXIT_FAILURE Error occurred.
  */
-LINKAGE int
+int
 head_main(int argc,
           char *argv[]){
-  int c;
-  int i;
+  struct head_args args;
   struct head head;
 
-  memset(&head, 0, sizeof(head));
-  head.nlines = HEAD_DEFAULT_LINES;
-  while((c = getopt(argc, argv, "n:")) != -1){
-    switch(c){
-      case 'n':
-        head_parse_nlines(&head, optarg);
-        break;
-      default:
-        head.status_code = EXIT_FAILURE;
-        break;
-    }
+  head_scan_init();
+  head_init(&head, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO);
+  head_parse_args(&head, argc, argv, &args);
+  if(head.status_code == 0 && args.client){
+    head_client(&head, args.client, argc - 1, argv + 1);
   }
-  argc -= optind;
-  argv += optind;
-
-  if(head.status_code == 0){
-    if(argc < 1){
-      head_fp(&head, stdin);
-    }
-    else{
-      for(i = 0; i < argc; i++){
-        if(argc > 1){
-          if(i > 0){
-            if(putchar('\n') != '\n'){
-              head_warn(&head, true, "putchar: <NL>");
-            }
-          }
-          if(printf("==> %s <==\n", argv[i]) < 0){
-            head_warn(&head, true, "printf: file header");
-          }
-        }
-        head_path(&head, argv[i]);
-      }
+  else if(head.status_code == 0 && args.serve){
+    if(head.jobs == 0){
+      head.jobs = head_nprocs();
     }
-    free(head.line);
+    head_serve(&head, args.serve);
+  }
+  else{
+    head_exec(&head, &args);
   }
   return head.status_code;
 }
-
-#ifndef TEST
-/**
- * Main program entry point.
- *
- * @param[in]     argc See @ref head_main.
- * @param[in,out] argv See @ref head_main.
- * @return             See @ref head_main.
- */
-int
-main(int argc,
-     char *argv[]){
-  return head_main(argc, argv);
-}
-#endif /* TEST */
-
@@ -0,0 +1,112 @@
+/**
+ * @file
+ * @brief head library
+ * @author James Humphrey (humphreyj@somnisoft.com)
+ *
+ * This software has been placed into the public domain using CC0.
+ *
+ * Prints the head lines or bytes of files, file descriptors, streams and
+ * memory buffers without starting a process. A context keeps its buffers
+ * between calls, so it should get reused for many inputs.
+ */
+#ifndef HEAD_H
+#define HEAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Head context, see @ref head_new.
+ */
+struct head;
+
+/**
+ * Output callback receiving the printed bytes.
+ *
+ * @param[in] arg Argument passed to @ref head_set_sink.
+ * @param[in] buf Printed bytes.
+ * @param[in] len Number of bytes in @p buf.
+ * @retval    0   Consumed all bytes.
+ * @retval    -1  Error occurred, stop printing with errno set.
+ */
+typedef int
+(*head_sink_fn)(void *arg,
+                const char *buf,
+                size_t len);
+
+/**
+ * Caller-supplied output buffer, filled by @ref head_sink_buf.
+ */
+struct head_buf{
+  /**
+   * Buffer receiving the printed bytes.
+   */
+  char *data;
+
+  /**
+   * Number of bytes available in @ref data.
+   */
+  size_t size;
+
+  /**
+   * Number of bytes printed into @ref data so far.
+   */
+  size_t len;
+};
+
+struct head *
+head_new(void);
+
+void
+head_free(struct head *head);
+
+void
+head_set_lines(struct head *head,
+               uintmax_t nlines,
+               bool elide);
+
+void
+head_set_bytes(struct head *head,
+               uintmax_t nbytes,
+               bool elide);
+
+void
+head_set_delim(struct head *head,
+               int delim);
+
+void
+head_set_sink(struct head *head,
+              head_sink_fn sink,
+              void *arg);
+
+int
+head_sink_buf(void *arg,
+              const char *buf,
+              size_t len);
+
+int
+head_print_fd(struct head *head,
+              int fd,
+              const char *name);
+
+int
+head_print_fp(struct head *head,
+              FILE *fp,
+              const char *name);
+
+int
+head_print_mem(struct head *head,
+               const void *buf,
+               size_t len);
+
+int
+head_print_path(struct head *head,
+                const char *path);
+
+int
+head_main(int argc,
+          char *argv[]);
+
+#endif /* HEAD_H */
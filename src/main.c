@@ -0,0 +1,22 @@
+/**
+ * @file
+ * @brief head utility
+ * @author James Humphrey (humphreyj@somnisoft.com)
+ *
+ * This software has been placed into the public domain using CC0.
+ */
+
+#include "head.h"
+
+/**
+ * Main program entry point.
+ *
+ * @param[in]     argc See @ref head_main.
+ * @param[in,out] argv See @ref head_main.
+ * @return             See @ref head_main.
+ */
+int
+main(int argc,
+     char *argv[]){
+  return head_main(argc, argv);
+}
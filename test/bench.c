@@ -0,0 +1,520 @@
+/**
+ * @file
+ * @brief Benchmark helper
+ * @author James Humphrey (humphreyj@somnisoft.com)
+ *
+ * This software has been placed into the public domain using CC0.
+ *
+ * Generates benchmark input files, evicts them from the page cache,
+ * measures single runs of the head utility and the latency of small
+ * requests for test/bench.sh.
+ */
+
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Number of bytes written by @ref bench_gen before leaving the rest of the
+ * file as a hole, unless overridden by the BENCH_DENSE environment
+ * variable.
+ */
+#define BENCH_DENSE (256 * 1024 * 1024)
+
+/**
+ * Size of the buffers used to generate and drain data.
+ */
+#define BENCH_BUF_SIZE (64 * 1024)
+
+/**
+ * Maximum size of the arguments sent by @ref bench_request.
+ */
+#define BENCH_MSG_SIZE 4096
+
+/**
+ * Print an error message and exit.
+ *
+ * @param[in] msg Message printed with the errno description.
+ */
+static void
+bench_die(const char *const msg){
+  perror(msg);
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * Parse a size argument with an optional K, M or G suffix.
+ *
+ * @param[in] s Size argument.
+ * @return      Size in bytes.
+ */
+static off_t
+bench_size(const char *const s){
+  char *ep;
+  off_t size;
+
+  size = (off_t)strtoul(s, &ep, 10);
+  switch(*ep){
+    case 'G':
+      size *= 1024;
+      /* fall through */
+    case 'M':
+      size *= 1024;
+      /* fall through */
+    case 'K':
+      size *= 1024;
+      break;
+    default:
+      break;
+  }
+  return size;
+}
+
+/**
+ * Generate a benchmark input file.
+ *
+ * Line shapes:
+ *   - short: lines of 1 to 80 bytes.
+ *   - long:  lines of 64 KiB.
+ *   - none:  no newline at all.
+ *
+ * Only the first BENCH_DENSE bytes get written, the rest of the file
+ * stays a hole reading back as NUL bytes, so files of tens of GB cost no
+ * disk space. The none shape consists of a hole only.
+ *
+ * @param[in] path  File to create.
+ * @param[in] size  File size in bytes.
+ * @param[in] shape Line shape.
+ */
+static void
+bench_gen(const char *const path,
+          const off_t size,
+          const char *const shape){
+  char *buf;
+  const char *env;
+  off_t dense;
+  off_t off;
+  size_t len;
+  size_t i;
+  size_t linelen;
+  unsigned long seed;
+  int fd;
+
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0){
+    bench_die(path);
+  }
+  buf = malloc(BENCH_BUF_SIZE);
+  if(buf == NULL){
+    bench_die("malloc");
+  }
+  env = getenv("BENCH_DENSE");
+  dense = env ? bench_size(env) : BENCH_DENSE;
+  if(strcmp(shape, "none") == 0 || dense > size){
+    dense = strcmp(shape, "none") == 0 ? 0 : size;
+  }
+  seed = 1;
+  linelen = 0;
+  for(off = 0; off < dense; off += (off_t)len){
+    len = BENCH_BUF_SIZE;
+    if(dense - off < (off_t)len){
+      len = (size_t)(dense - off);
+    }
+    for(i = 0; i < len; i++){
+      if(linelen == 0){
+        seed = seed * 1103515245UL + 12345UL;
+        linelen = strcmp(shape, "long") == 0 ? 64 * 1024
+                                               : 1 + (seed >> 16) % 80;
+      }
+      linelen -= 1;
+      buf[i] = linelen == 0 ? '\n' : (char)('a' + (seed >> 8) % 26);
+    }
+    if(write(fd, buf, len) != (ssize_t)len){
+      bench_die(path);
+    }
+  }
+  if(ftruncate(fd, size) != 0 || close(fd) != 0){
+    bench_die(path);
+  }
+  free(buf);
+}
+
+/**
+ * Drop the cached pages of files, so the next run reads them from storage.
+ *
+ * @param[in] paths Files to evict, terminated by NULL.
+ */
+static void
+bench_evict(char *const paths[]){
+  int fd;
+  int i;
+
+  for(i = 0; paths[i]; i++){
+    fd = open(paths[i], O_RDONLY);
+    if(fd < 0 ||
+       fdatasync(fd) != 0 ||
+       posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0 ||
+       close(fd) != 0){
+      bench_die(paths[i]);
+    }
+  }
+}
+
+/**
+ * Get the current time in seconds.
+ *
+ * @return Monotonic time in seconds.
+ */
+static double
+bench_now(void){
+  struct timespec ts;
+
+  if(clock_gettime(CLOCK_MONOTONIC, &ts) != 0){
+    bench_die("clock_gettime");
+  }
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * Count the system calls made by a process and all its threads.
+ *
+ * @param[in] pid Traced child, stopped before calling exec.
+ * @return        Number of system calls.
+ */
+static unsigned long
+bench_trace(const pid_t pid){
+  unsigned long nstops;
+  pid_t tid;
+  int status;
+  int sig;
+
+  if(ptrace(PTRACE_SETOPTIONS,
+            pid,
+            NULL,
+            (void *)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE)) != 0 ||
+     ptrace(PTRACE_SYSCALL, pid, NULL, NULL) != 0){
+    bench_die("ptrace");
+  }
+  nstops = 0;
+  while((tid = waitpid(-1, &status, __WALL)) > 0){
+    if(WIFEXITED(status) || WIFSIGNALED(status)){
+      continue;
+    }
+    sig = 0;
+    if(WSTOPSIG(status) == (SIGTRAP | 0x80)){
+      nstops += 1;
+    }
+    else if(WSTOPSIG(status) != SIGTRAP && WSTOPSIG(status) != SIGSTOP){
+      sig = WSTOPSIG(status);
+    }
+    ptrace(PTRACE_SYSCALL, tid, NULL, (void *)(long)sig);
+  }
+  return nstops / 2;
+}
+
+/**
+ * Run a command once and print its measurements as CSV fields.
+ *
+ * Prints the wall time in seconds, the peak RSS in KiB, the number of
+ * output bytes and lines, and the number of system calls if traced.
+ *
+ * @param[in] out   STDOUT type: file, pipe or null.
+ * @param[in] trace Count system calls instead of timing the run.
+ * @param[in] argv  Command to run.
+ */
+static void
+bench_run(const char *const out,
+          const int trace,
+          char *const argv[]){
+  struct rusage ru;
+  unsigned long nsys;
+  unsigned long nbytes;
+  unsigned long nlines;
+  char *buf;
+  double start;
+  double wall;
+  ssize_t nread;
+  ssize_t i;
+  pid_t pid;
+  int pipefd[2];
+  int status;
+  int fd;
+
+  if(trace && strcmp(out, "pipe") == 0){
+    fprintf(stderr, "bench: trace only supports file or null output\n");
+    exit(EXIT_FAILURE);
+  }
+  buf = malloc(BENCH_BUF_SIZE);
+  if(buf == NULL){
+    bench_die("malloc");
+  }
+  if(strcmp(out, "pipe") == 0 && pipe(pipefd) != 0){
+    bench_die("pipe");
+  }
+  start = bench_now();
+  pid = fork();
+  if(pid < 0){
+    bench_die("fork");
+  }
+  if(pid == 0){
+    if(strcmp(out, "pipe") == 0){
+      fd = pipefd[1];
+      close(pipefd[0]);
+    }
+    else if(strcmp(out, "null") == 0){
+      fd = open("/dev/null", O_WRONLY);
+    }
+    else{
+      fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if(fd < 0 || dup2(fd, STDOUT_FILENO) < 0){
+      bench_die(out);
+    }
+    close(fd);
+    if(trace){
+      ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+      raise(SIGSTOP);
+    }
+    execvp(argv[0], argv);
+    bench_die(argv[0]);
+  }
+  nbytes = 0;
+  nlines = 0;
+  nsys = 0;
+  if(strcmp(out, "pipe") == 0){
+    close(pipefd[1]);
+    while((nread = read(pipefd[0], buf, BENCH_BUF_SIZE)) > 0){
+      nbytes += (unsigned long)nread;
+      for(i = 0; i < nread; i++){
+        nlines += (buf[i] == '\n');
+      }
+    }
+    close(pipefd[0]);
+  }
+  if(trace){
+    if(waitpid(pid, &status, 0) != pid){
+      bench_die("waitpid");
+    }
+    nsys = bench_trace(pid);
+    memset(&ru, 0, sizeof(ru));
+  }
+  else if(wait4(pid, &status, 0, &ru) != pid){
+    bench_die("wait4");
+  }
+  wall = bench_now() - start;
+  if(strcmp(out, "pipe") != 0 && strcmp(out, "null") != 0){
+    fd = open(out, O_RDONLY);
+    while(fd >= 0 && (nread = read(fd, buf, BENCH_BUF_SIZE)) > 0){
+      nbytes += (unsigned long)nread;
+      for(i = 0; i < nread; i++){
+        nlines += (buf[i] == '\n');
+      }
+    }
+    if(fd >= 0){
+      close(fd);
+    }
+  }
+  printf("%.6f,%ld,%lu,%lu,%lu\n",
+         wall,
+         ru.ru_maxrss,
+         nbytes,
+         nlines,
+         nsys);
+  free(buf);
+}
+
+/**
+ * Send one request to a head server with STDOUT and STDERR redirected to
+ * /dev/null, and wait for its exit status.
+ *
+ * @param[in] sock Path of the server socket.
+ * @param[in] argv Request arguments, without the program name.
+ * @param[in] null File descriptor of /dev/null.
+ * @param[in] cwd  File descriptor of the working directory.
+ * @return         Exit status of the request.
+ */
+static int
+bench_request(const char *const sock,
+              char *const argv[],
+              const int null,
+              const int cwd){
+  union{
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(int) * 4)];
+  } ctl;
+  struct sockaddr_un addr;
+  struct msghdr mh;
+  struct cmsghdr *cm;
+  struct iovec iov;
+  char msg[BENCH_MSG_SIZE];
+  size_t len;
+  size_t n;
+  int fds[4];
+  int status;
+  int fd;
+  int i;
+
+  len = 0;
+  for(i = 0; argv[i]; i++){
+    n = strlen(argv[i]) + 1;
+    if(len + n > sizeof(msg)){
+      fprintf(stderr, "bench: request too long\n");
+      exit(EXIT_FAILURE);
+    }
+    memcpy(msg + len, argv[i], n);
+    len += n;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, sock, sizeof(addr.sun_path) - 1);
+  fds[0] = null;
+  fds[1] = null;
+  fds[2] = null;
+  fds[3] = cwd;
+  iov.iov_base = msg;
+  iov.iov_len = len;
+  memset(&mh, 0, sizeof(mh));
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = ctl.buf;
+  mh.msg_controllen = sizeof(ctl.buf);
+  cm = CMSG_FIRSTHDR(&mh);
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+  fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if(fd < 0 ||
+     connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+     sendmsg(fd, &mh, 0) != (ssize_t)len ||
+     recv(fd, &status, sizeof(status), 0) != sizeof(status)){
+    bench_die(sock);
+  }
+  close(fd);
+  return status;
+}
+
+/**
+ * Measure the latency of small head runs and print it as CSV fields.
+ *
+ * Each run either starts the command as a new process, or sends its
+ * arguments as a request to a head server, with the output discarded in
+ * both cases. Prints the mean and the fastest wall time per run in
+ * seconds.
+ *
+ * @param[in] count Number of runs.
+ * @param[in] sock  Path of the server socket, or "-" to start a process
+ *                  for each run.
+ * @param[in] argv  Command to run.
+ */
+static void
+bench_latency(const unsigned long count,
+              const char *const sock,
+              char *const argv[]){
+  unsigned long i;
+  double start;
+  double wall;
+  double best;
+  double total;
+  pid_t pid;
+  int status;
+  int null;
+  int cwd;
+
+  null = open("/dev/null", O_RDWR | O_CLOEXEC);
+  cwd = open(".", O_RDONLY | O_CLOEXEC);
+  if(null < 0 || cwd < 0){
+    bench_die("open");
+  }
+  best = 0;
+  total = 0;
+  for(i = 0; i < count; i++){
+    start = bench_now();
+    if(strcmp(sock, "-") != 0){
+      status = bench_request(sock, argv + 1, null, cwd);
+    }
+    else{
+      pid = fork();
+      if(pid < 0){
+        bench_die("fork");
+      }
+      if(pid == 0){
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execvp(argv[0], argv);
+        bench_die(argv[0]);
+      }
+      if(waitpid(pid, &status, 0) != pid){
+        bench_die("waitpid");
+      }
+      status = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+    }
+    wall = bench_now() - start;
+    if(status != 0){
+      fprintf(stderr, "bench: %s: exit status %d\n", argv[0], status);
+      exit(EXIT_FAILURE);
+    }
+    total += wall;
+    if(i == 0 || wall < best){
+      best = wall;
+    }
+  }
+  printf("%.6f,%.6f\n", count ? total / (double)count : 0, best);
+  close(null);
+  close(cwd);
+}
+
+/**
+ * Benchmark helper entry point.
+ *
+ * Usage:
+ * bench gen file size short|long|none
+ * bench evict file...
+ * bench run|trace file|pipe|null command [argument...]
+ * bench latency count socket|- command [argument...]
+ *
+ * @param[in] argc Number of arguments in @p argv.
+ * @param[in] argv Argument list.
+ * @retval    0    Successful.
+ */
+int
+main(int argc,
+     char *argv[]){
+  if(argc == 5 && strcmp(argv[1], "gen") == 0){
+    bench_gen(argv[2], bench_size(argv[3]), argv[4]);
+  }
+  else if(argc > 2 && strcmp(argv[1], "evict") == 0){
+    bench_evict(argv + 2);
+  }
+  else if(argc > 3 && strcmp(argv[1], "run") == 0){
+    bench_run(argv[2], 0, argv + 3);
+  }
+  else if(argc > 3 && strcmp(argv[1], "trace") == 0){
+    bench_run(argv[2], 1, argv + 3);
+  }
+  else if(argc > 4 && strcmp(argv[1], "latency") == 0){
+    bench_latency(strtoul(argv[2], NULL, 10), argv[3], argv + 4);
+  }
+  else{
+    fprintf(stderr, "usage: bench gen file size short|long|none\n"
+                    "       bench evict file...\n"
+                    "       bench run|trace file|pipe|null command...\n"
+                    "       bench latency count socket|- command...\n");
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
@@ -0,0 +1,200 @@
+#!/bin/sh
+##
+## @file
+## @brief Benchmark suite for the head utility.
+## @author James Humphrey (humphreyj@somnisoft.com)
+##
+## This software has been placed into the public domain using CC0.
+##
+## Runs the head utility over a matrix of file sizes, line shapes, line
+## counts, STDOUT types and engines, and writes one CSV row per run. Then
+## measures the latency of small requests, started as new processes or
+## served by a running --serve instance, and writes one CSV row per mode.
+##
+## Environment variables (defaults in brackets):
+##   HEAD           head binary [build/release/head]
+##   HEAD_BASE      baseline head binary timed for every case as well, such
+##                  as a build without USDT probes, to check that probes
+##                  cost nothing while no tracer is attached [none]
+##   BENCH          benchmark helper [build/release/bench]
+##   BENCH_DATA     directory for the generated input files [/tmp/head-bench]
+##   BENCH_OUT      CSV results file [build/bench.csv]
+##   BENCH_SIZES    file sizes, K/M/G suffixes allowed [64K 16M 256M]
+##   BENCH_SHAPES   line shapes: short, long, none [short long none]
+##   BENCH_COUNTS   -n values [10 100000 10000000]
+##   BENCH_STDOUT   STDOUT types: file, pipe, null [file pipe null]
+##   BENCH_ENGINES  engines: read, map, index, serial, uring, pool
+##                  [read map index serial uring pool]
+##   BENCH_REPEAT   runs per case, the fastest one gets reported [3]
+##   BENCH_DENSE    bytes of real lines per file before the hole [256M]
+##   BENCH_COLD     1 to evict the input files from the page cache before
+##                  each timed run, so they get read from storage [0]
+##   BENCH_LATENCY  requests per latency mode, 0 to skip [1000]
+##   BENCH_LAT_OUT  latency CSV results file [build/bench-latency.csv]
+##
+## Engines:
+##   read   file redirected to STDIN, read in blocks.
+##   map    file operand, scanned through mmap and copied by the kernel.
+##   index  file operand with a warm --index-dir line-offset index.
+##   serial 4 copies of the file as operands, printed one after another
+##          with the next ones read ahead.
+##   uring  32 file operands, opened and read through io_uring.
+##   pool   32 file operands, printed by 4 worker threads (-j 4).
+##
+## Latency modes, each printing -n 10 of a 64 KiB file:
+##   exec    new head process per request.
+##   client  new head --client process per request.
+##   socket  request sent straight to the --serve socket.
+##
+set -e
+
+HEAD=${HEAD:-build/release/head}
+HEAD_BASE=${HEAD_BASE:-}
+BENCH=${BENCH:-build/release/bench}
+BENCH_DATA=${BENCH_DATA:-/tmp/head-bench}
+BENCH_OUT=${BENCH_OUT:-build/bench.csv}
+BENCH_SIZES=${BENCH_SIZES:-64K 16M 256M}
+BENCH_SHAPES=${BENCH_SHAPES:-short long none}
+BENCH_COUNTS=${BENCH_COUNTS:-10 100000 10000000}
+BENCH_STDOUT=${BENCH_STDOUT:-file pipe null}
+BENCH_ENGINES=${BENCH_ENGINES:-read map index serial uring pool}
+BENCH_REPEAT=${BENCH_REPEAT:-3}
+BENCH_COLD=${BENCH_COLD:-0}
+BENCH_LATENCY=${BENCH_LATENCY:-1000}
+BENCH_LAT_OUT=${BENCH_LAT_OUT:-build/bench-latency.csv}
+
+mkdir -p "$BENCH_DATA" "$BENCH_DATA/index"
+out_file="$BENCH_DATA/out"
+
+# Print the command line running an engine over an input file, using the
+# head binary in $head.
+engine_args(){
+  engine=$1
+  input=$2
+  count=$3
+  case $engine in
+    read)  echo "$head -n $count" ;;
+    map)   echo "$head -n $count $input" ;;
+    index) echo "$head --index-dir=$BENCH_DATA/index -n $count $input" ;;
+    serial) echo "$head -n $count $(copies "$input")" ;;
+    uring) echo "$head -n $count $(many "$input")" ;;
+    pool)  echo "$head -j 4 -n $count $(many "$input")" ;;
+  esac
+}
+
+# Print 32 hard links to an input file, creating them if needed.
+many(){
+  for i in 0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 \
+           16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31; do
+    link="$1.$i"
+    [ -e "$link" ] || ln "$1" "$link"
+    printf '%s ' "$link"
+  done
+}
+
+# Print 4 copies of an input file, with their own pages in the page cache,
+# creating them if needed.
+copies(){
+  for i in 0 1 2 3; do
+    copy="$1.copy$i"
+    [ -e "$copy" ] || cp --sparse=always "$1" "$copy"
+    printf '%s ' "$copy"
+  done
+}
+
+# Run an engine once, printing the helper's CSV fields.
+run(){
+  mode=$1
+  stdout=$2
+  engine=$3
+  input=$4
+  count=$5
+  [ "$stdout" = file ] && stdout=$out_file
+  if [ "$BENCH_COLD" = 1 ]; then
+    # shellcheck disable=SC2046
+    $BENCH evict "$input" $(copies "$input")
+  fi
+  # shellcheck disable=SC2046
+  if [ "$engine" = read ]; then
+    $BENCH "$mode" "$stdout" $(engine_args "$engine" "$input" "$count") \
+      < "$input"
+  else
+    $BENCH "$mode" "$stdout" $(engine_args "$engine" "$input" "$count")
+  fi
+}
+
+# Print the fastest wall time of $BENCH_REPEAT runs of one case.
+best_wall(){
+  best=
+  i=0
+  while [ "$i" -lt "$BENCH_REPEAT" ]; do
+    res=$(run run "$@")
+    best=$(printf '%s\n%s\n' "$best" "$res" | sort -t, -k1,1g |
+           grep . | head -n 1)
+    i=$((i + 1))
+  done
+  echo "$best"
+}
+
+head=$HEAD
+printf '%s,%s\n' "engine,size,shape,count,stdout,wall_s,gb_per_s,lines_per_s" \
+                "bytes,lines,maxrss_kb,syscalls,base_wall_s" > "$BENCH_OUT"
+for size in $BENCH_SIZES; do
+  for shape in $BENCH_SHAPES; do
+    input="$BENCH_DATA/$shape-$size.txt"
+    [ -e "$input" ] || $BENCH gen "$input" "$size" "$shape"
+    for count in $BENCH_COUNTS; do
+      for engine in $BENCH_ENGINES; do
+        # Warm the page cache and the line-offset index, and count the
+        # output bytes and lines once for all STDOUT types.
+        ref=$(run run pipe "$engine" "$input" "$count")
+        for stdout in $BENCH_STDOUT; do
+          best=$(best_wall "$stdout" "$engine" "$input" "$count")
+          base=
+          if [ -n "$HEAD_BASE" ]; then
+            head=$HEAD_BASE
+            base=$(best_wall "$stdout" "$engine" "$input" "$count" |
+                   cut -d, -f1)
+            head=$HEAD
+          fi
+          syscalls=
+          if [ "$stdout" != pipe ]; then
+            syscalls=$(run trace "$stdout" "$engine" "$input" "$count" |
+                       cut -d, -f5)
+          fi
+          echo "$best,$ref" |
+            awk -F, -v pre="$engine,$size,$shape,$count,$stdout" \
+                    -v sys="$syscalls" -v base="$base" '{
+              wall = $1 > 0 ? $1 : 1e-9
+              printf "%s,%s,%.3f,%.0f,%s,%s,%s,%s,%s\n", pre, $1,
+                     $8 / wall / 1e9, $9 / wall, $8, $9, $2, sys, base
+            }' | tee -a "$BENCH_OUT"
+        done
+      done
+    done
+  done
+done
+rm -f "$out_file"
+
+[ "$BENCH_LATENCY" -gt 0 ] || exit 0
+input="$BENCH_DATA/short-64K.txt"
+[ -e "$input" ] || $BENCH gen "$input" 64K short
+sock="$BENCH_DATA/head.sock"
+rm -f "$sock"
+$HEAD --serve="$sock" &
+serve_pid=$!
+trap 'kill "$serve_pid"' EXIT
+while [ ! -S "$sock" ]; do
+  sleep 0.1
+done
+echo "mode,requests,mean_s,best_s" > "$BENCH_LAT_OUT"
+for mode in exec client socket; do
+  case $mode in
+    exec)   res=$($BENCH latency "$BENCH_LATENCY" - "$HEAD" -n 10 "$input") ;;
+    client) res=$($BENCH latency "$BENCH_LATENCY" - "$HEAD" --client="$sock" \
+                    -n 10 "$input") ;;
+    socket) res=$($BENCH latency "$BENCH_LATENCY" "$sock" "$HEAD" -n 10 \
+                    "$input") ;;
+  esac
+  echo "$mode,$BENCH_LATENCY,$res" | tee -a "$BENCH_LAT_OUT"
+done
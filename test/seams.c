@@ -6,42 +6,101 @@
  * This software has been placed into the public domain using CC0.
  */
 
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "test.h"
 
 /**
- * Error counter for @ref test_seam_fclose.
+ * Error counter for @ref test_seam_close.
  */
-int g_test_seam_err_ctr_fclose = -1;
+int g_test_seam_err_ctr_close = -1;
 
 /**
- * Error counter for @ref test_seam_ferror.
+ * Error counter for @ref test_seam_copy_file_range.
  */
-int g_test_seam_err_ctr_ferror = -1;
+int g_test_seam_err_ctr_copy_file_range = -1;
 
 /**
- * Error counter for @ref test_seam_fwrite.
+ * Error counter for @ref test_seam_fstat.
  */
-int g_test_seam_err_ctr_fwrite = -1;
+int g_test_seam_err_ctr_fstat = -1;
 
 /**
- * Error counter for @ref test_seam_getline.
+ * Error counter for @ref test_seam_lseek.
  */
-int g_test_seam_err_ctr_getline = -1;
+int g_test_seam_err_ctr_lseek = -1;
 
 /**
- * Error counter for @ref test_seam_printf.
+ * Error counter for @ref test_seam_malloc.
  */
-int g_test_seam_err_ctr_printf = -1;
+int g_test_seam_err_ctr_malloc = -1;
 
 /**
- * Error counter for @ref test_seam_putchar.
+ * Error counter for @ref test_seam_mmap.
  */
-int g_test_seam_err_ctr_putchar = -1;
+int g_test_seam_err_ctr_mmap = -1;
+
+/**
+ * Error counter for @ref test_seam_munmap.
+ */
+int g_test_seam_err_ctr_munmap = -1;
+
+/**
+ * Error counter for @ref test_seam_pthread_create.
+ */
+int g_test_seam_err_ctr_pthread_create = -1;
+
+/**
+ * Error counter for @ref test_seam_pread.
+ */
+int g_test_seam_err_ctr_pread = -1;
+
+/**
+ * Error counter for @ref test_seam_read.
+ */
+int g_test_seam_err_ctr_read = -1;
+
+/**
+ * Error counter for @ref test_seam_realloc.
+ */
+int g_test_seam_err_ctr_realloc = -1;
+
+/**
+ * Error counter for @ref test_seam_sendfile.
+ */
+int g_test_seam_err_ctr_sendfile = -1;
+
+/**
+ * Error counter for @ref test_seam_splice.
+ */
+int g_test_seam_err_ctr_splice = -1;
+
+/**
+ * Error counter for @ref test_seam_syscall.
+ */
+int g_test_seam_err_ctr_syscall = -1;
+
+/**
+ * Error counter for @ref test_seam_writev.
+ */
+int g_test_seam_err_ctr_writev = -1;
+
+/**
+ * Error code set by the kernel copy test seams when they fail.
+ */
+int g_test_seam_copy_errno = EIO;
 
 /**
  * Decrement an error counter until it reaches -1.
@@ -72,139 +131,406 @@ test_seam_dec_err_ctr(int *const err_ctr){
 }
 
 /**
- * Control when fclose() fails.
+ * Control when close() fails.
  *
- * @param[in,out] stream File pointer.
- * @retval        0      Successfully closed file.
- * @retval        EOF    Failed to close file.
+ * @param[in] fildes File descriptor to close.
+ * @retval    0      Successfully closed file descriptor.
+ * @retval    -1     Failed to close file descriptor.
  */
 int
-test_seam_fclose(FILE *stream){
+test_seam_close(int fildes){
   int rc;
 
-  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_fclose)){
-    rc = EOF;
-    errno = EBADF;
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_close)){
+    close(fildes);
+    rc = -1;
+    errno = EIO;
   }
   else{
-    rc = fclose(stream);
+    rc = close(fildes);
   }
   return rc;
 }
 
 /**
- * Control when ferror() fails.
+ * Control when copy_file_range() fails.
+ *
+ * @param[in]     fd_in   File descriptor to copy from.
+ * @param[in,out] off_in  Offset in @p fd_in.
+ * @param[in]     fd_out  File descriptor to copy to.
+ * @param[in,out] off_out Offset in @p fd_out.
+ * @param[in]     len     Number of bytes to copy.
+ * @param[in]     flags   Must be 0.
+ * @retval        >=0     Number of bytes copied.
+ * @retval        -1      Error occurred.
+ */
+ssize_t
+test_seam_copy_file_range(int fd_in,
+                          loff_t *off_in,
+                          int fd_out,
+                          loff_t *off_out,
+                          size_t len,
+                          unsigned int flags){
+  ssize_t ncopy;
+
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_copy_file_range)){
+    ncopy = -1;
+    errno = g_test_seam_copy_errno;
+  }
+  else{
+    ncopy = copy_file_range(fd_in, off_in, fd_out, off_out, len, flags);
+  }
+  return ncopy;
+}
+
+/**
+ * Control when fstat() fails.
  *
- * @param[in] stream File pointer.
- * @retval    0      File error indicator not set.
- * @retval    !0     File error indicator set.
+ * @param[in]  fildes File descriptor.
+ * @param[out] buf    File status information.
+ * @retval     0      Successfully read file status.
+ * @retval     -1     Failed to read file status.
  */
 int
-test_seam_ferror(FILE *stream){
+test_seam_fstat(int fildes,
+                struct stat *buf){
   int rc;
 
-  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_ferror)){
-    rc = 1;
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_fstat)){
+    rc = -1;
+    errno = EIO;
   }
   else{
-    rc = ferror(stream);
+    rc = fstat(fildes, buf);
   }
   return rc;
 }
 
 /**
- * Control when fwrite() fails.
+ * Control when lseek() fails.
  *
- * @param[in]     ptr    Data to write to @p stream.
- * @param[in]     size   Size of each element in @p nitems.
- * @param[in]     nitems Number of items to write.
- * @param[in,out] stream File pointer to write to.
- * @return               Number of @p items written to @p stream.
+ * @param[in] fildes File descriptor.
+ * @param[in] offset New file offset relative to @p whence.
+ * @param[in] whence SEEK_SET, SEEK_CUR or SEEK_END.
+ * @retval    >=0    Resulting file offset.
+ * @retval    -1     Failed to seek.
  */
-size_t
-test_seam_fwrite(const void *ptr,
-                 size_t size,
-                 size_t nitems,
-                 FILE *stream){
-  size_t nwrite;
+off_t
+test_seam_lseek(int fildes,
+                off_t offset,
+                int whence){
+  off_t rc;
 
-  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_fwrite)){
-    nwrite = 0;
-    errno = EPIPE;
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_lseek)){
+    rc = -1;
+    errno = EBADF;
   }
   else{
-    nwrite = fwrite(ptr, size, nitems, stream);
+    rc = lseek(fildes, offset, whence);
   }
-  return nwrite;
+  return rc;
 }
 
 /**
- * Control when getline() fails.
+ * Control when malloc() fails.
  *
- * @param[in,out] lineptr Line buffer that may get reallocated.
- * @param[in,out] n       Number of bytes allocated in @p lineptr.
- * @param[in,out] stream  File pointer to read from.
- * @retval        >=0     Number of bytes read.
- * @retval        -1      Error occurred.
+ * @param[in] size Number of bytes to allocate.
+ * @retval    void* Pointer to new allocated memory.
+ * @retval    NULL  Memory allocation failed.
  */
-ssize_t
-test_seam_getline(char **lineptr,
-                  size_t *n,
-                  FILE *stream){
-  ssize_t linelen;
+void *
+test_seam_malloc(size_t size){
+  void *mem;
 
-  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_getline)){
-    linelen = -1;
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_malloc)){
+    mem = NULL;
     errno = ENOMEM;
   }
   else{
-    linelen = getline(lineptr, n, stream);
+    mem = malloc(size);
   }
-  return linelen;
+  return mem;
 }
 
 /**
- * Control when printf() fails.
+ * Control when mmap() fails.
  *
- * @param[in] format Format argument list to print.
- * @retval    >=0    Number of bytes written.
- * @retval    <0     Output error.
+ * @param[in] addr   Requested address of the mapping.
+ * @param[in] len    Number of bytes to map.
+ * @param[in] prot   Memory protection flags.
+ * @param[in] flags  Mapping flags.
+ * @param[in] fildes File descriptor to map.
+ * @param[in] off    File offset of the mapping.
+ * @retval    void*      Address of the new mapping.
+ * @retval    MAP_FAILED Failed to create the mapping.
+ */
+void *
+test_seam_mmap(void *addr,
+               size_t len,
+               int prot,
+               int flags,
+               int fildes,
+               off_t off){
+  void *map;
+
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_mmap)){
+    map = MAP_FAILED;
+    errno = ENODEV;
+  }
+  else{
+    map = mmap(addr, len, prot, flags, fildes, off);
+  }
+  return map;
+}
+
+/**
+ * Control when munmap() fails.
+ *
+ * @param[in] addr Address of the mapping.
+ * @param[in] len  Number of bytes in the mapping.
+ * @retval    0    Successfully removed the mapping.
+ * @retval    -1   Failed to remove the mapping.
  */
 int
-test_seam_printf(const char *format, ...){
-  int bytes_written;
-  va_list ap;
+test_seam_munmap(void *addr,
+                 size_t len){
+  int rc;
 
-  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_printf)){
-    bytes_written = -1;
-    errno = ENOMEM;
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_munmap)){
+    munmap(addr, len);
+    rc = -1;
+    errno = EINVAL;
   }
   else{
-    va_start(ap, format);
-    bytes_written = vprintf(format, ap);
-    va_end(ap);
+    rc = munmap(addr, len);
   }
-  return bytes_written;
+  return rc;
 }
 
 /**
- * Control when putchar() fails.
+ * Control when pthread_create() fails.
  *
- * @param[in] c   Byte to write.
- * @retval    c   Successfully wrote @p c.
- * @retval    EOF Error occurred.
+ * @param[out] thread        Thread ID of the new thread.
+ * @param[in]  attr          Thread attributes.
+ * @param[in]  start_routine Function run by the new thread.
+ * @param[in]  arg           Argument passed to @p start_routine.
+ * @retval     0             Successfully created the thread.
+ * @retval     EAGAIN        Failed to create the thread.
  */
 int
-test_seam_putchar(int c){
-  int byte_written;
+test_seam_pthread_create(pthread_t *thread,
+                         const pthread_attr_t *attr,
+                         void *(*start_routine)(void *),
+                         void *arg){
+  int rc;
+
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_pthread_create)){
+    rc = EAGAIN;
+  }
+  else{
+    rc = pthread_create(thread, attr, start_routine, arg);
+  }
+  return rc;
+}
 
-  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_putchar)){
-    byte_written = EOF;
+/**
+ * Control when pread() fails.
+ *
+ * @param[in]  fildes File descriptor to read from.
+ * @param[out] buf    Buffer to store bytes read.
+ * @param[in]  nbyte  Maximum number of bytes to read.
+ * @param[in]  offset File offset to read at.
+ * @retval     >=0    Number of bytes read.
+ * @retval     -1     Error occurred.
+ */
+ssize_t
+test_seam_pread(int fildes,
+                void *buf,
+                size_t nbyte,
+                off_t offset){
+  ssize_t nread;
+
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_pread)){
+    nread = -1;
+    errno = EIO;
+  }
+  else{
+    nread = pread(fildes, buf, nbyte, offset);
+  }
+  return nread;
+}
+
+/**
+ * Control when read() fails.
+ *
+ * @param[in]  fildes File descriptor to read from.
+ * @param[out] buf    Buffer to store bytes read.
+ * @param[in]  nbyte  Maximum number of bytes to read.
+ * @retval     >=0    Number of bytes read.
+ * @retval     -1     Error occurred.
+ */
+ssize_t
+test_seam_read(int fildes,
+               void *buf,
+               size_t nbyte){
+  ssize_t nread;
+
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_read)){
+    nread = -1;
+    errno = EIO;
+  }
+  else{
+    nread = read(fildes, buf, nbyte);
+  }
+  return nread;
+}
+
+/**
+ * Control when realloc() fails.
+ *
+ * @param[in] ptr   Previously allocated memory or NULL.
+ * @param[in] size  Number of bytes to allocate.
+ * @retval    void* Pointer to new allocated memory.
+ * @retval    NULL  Memory allocation failed.
+ */
+void *
+test_seam_realloc(void *ptr,
+                  size_t size){
+  void *mem;
+
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_realloc)){
+    mem = NULL;
     errno = ENOMEM;
   }
   else{
-    byte_written = putchar(c);
+    mem = realloc(ptr, size);
   }
-  return byte_written;
+  return mem;
 }
 
+/**
+ * Control when sendfile() fails.
+ *
+ * @param[in]     out_fd File descriptor to copy to.
+ * @param[in]     in_fd  File descriptor to copy from.
+ * @param[in,out] offset Offset in @p in_fd.
+ * @param[in]     count  Number of bytes to copy.
+ * @retval        >=0    Number of bytes copied.
+ * @retval        -1     Error occurred.
+ */
+ssize_t
+test_seam_sendfile(int out_fd,
+                   int in_fd,
+                   off_t *offset,
+                   size_t count){
+  ssize_t ncopy;
+
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_sendfile)){
+    ncopy = -1;
+    errno = g_test_seam_copy_errno;
+  }
+  else{
+    ncopy = sendfile(out_fd, in_fd, offset, count);
+  }
+  return ncopy;
+}
+
+/**
+ * Control when splice() fails.
+ *
+ * @param[in]     fd_in   File descriptor to copy from.
+ * @param[in,out] off_in  Offset in @p fd_in.
+ * @param[in]     fd_out  File descriptor to copy to.
+ * @param[in,out] off_out Offset in @p fd_out.
+ * @param[in]     len     Number of bytes to copy.
+ * @param[in]     flags   Splice flags.
+ * @retval        >=0     Number of bytes copied.
+ * @retval        -1      Error occurred.
+ */
+ssize_t
+test_seam_splice(int fd_in,
+                 loff_t *off_in,
+                 int fd_out,
+                 loff_t *off_out,
+                 size_t len,
+                 unsigned int flags){
+  ssize_t ncopy;
+
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_splice)){
+    ncopy = -1;
+    errno = g_test_seam_copy_errno;
+  }
+  else{
+    ncopy = splice(fd_in, off_in, fd_out, off_out, len, flags);
+  }
+  return ncopy;
+}
+
+/**
+ * Control when syscall() fails.
+ *
+ * Only supports the system calls made by the head utility.
+ *
+ * @param[in] number System call number.
+ * @retval    >=0    System call succeeded.
+ * @retval    -1     Error occurred.
+ */
+long
+test_seam_syscall(long number, ...){
+  va_list ap;
+  long rc;
+  int fd;
+  unsigned int entries;
+  unsigned int to_submit;
+  unsigned int min_complete;
+  unsigned int flags;
+  void *arg;
+  size_t argsz;
+
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_syscall)){
+    errno = ENOSYS;
+    return -1;
+  }
+  va_start(ap, number);
+  if(number == __NR_io_uring_setup){
+    entries = va_arg(ap, unsigned int);
+    arg = va_arg(ap, void *);
+    rc = syscall(number, entries, arg);
+  }
+  else{
+    fd = va_arg(ap, int);
+    to_submit = va_arg(ap, unsigned int);
+    min_complete = va_arg(ap, unsigned int);
+    flags = va_arg(ap, unsigned int);
+    arg = va_arg(ap, void *);
+    argsz = va_arg(ap, size_t);
+    rc = syscall(number, fd, to_submit, min_complete, flags, arg, argsz);
+  }
+  va_end(ap);
+  return rc;
+}
+
+/**
+ * Control when writev() fails.
+ *
+ * @param[in] fildes File descriptor to write to.
+ * @param[in] iov    Buffers to write.
+ * @param[in] iovcnt Number of buffers in @p iov.
+ * @retval    >=0    Number of bytes written.
+ * @retval    -1     Error occurred.
+ */
+ssize_t
+test_seam_writev(int fildes,
+                 const struct iovec *iov,
+                 int iovcnt){
+  ssize_t nwrite;
+
+  if(test_seam_dec_err_ctr(&g_test_seam_err_ctr_writev)){
+    nwrite = -1;
+    errno = EPIPE;
+  }
+  else{
+    nwrite = writev(fildes, iov, iovcnt);
+  }
+  return nwrite;
+}
@@ -13,42 +13,96 @@
 /*
  * Redefine these functions to internal test seams.
  */
-#undef fclose
-#undef ferror
-#undef fwrite
-#undef getline
-#undef printf
-#undef putchar
+#undef close
+#undef copy_file_range
+#undef fstat
+#undef lseek
+#undef malloc
+#undef mmap
+#undef munmap
+#undef pthread_create
+#undef pread
+#undef read
+#undef realloc
+#undef sendfile
+#undef splice
+#undef syscall
+#undef writev
 
 /**
- * Inject a test seam to replace fclose().
+ * Inject a test seam to replace close().
  */
-#define fclose test_seam_fclose
+#define close test_seam_close
 
 /**
- * Inject a test seam to replace ferror().
+ * Inject a test seam to replace copy_file_range().
  */
-#define ferror test_seam_ferror
+#define copy_file_range test_seam_copy_file_range
 
 /**
- * Inject a test seam to replace fwrite().
+ * Inject a test seam to replace fstat().
  */
-#define fwrite test_seam_fwrite
+#define fstat test_seam_fstat
 
 /**
- * Inject a test seam to replace getline().
+ * Inject a test seam to replace lseek().
  */
-#define getline test_seam_getline
+#define lseek test_seam_lseek
 
 /**
- * Inject a test seam to replace printf().
+ * Inject a test seam to replace malloc().
  */
-#define printf test_seam_printf
+#define malloc test_seam_malloc
 
 /**
- * Inject a test seam to replace putchar().
+ * Inject a test seam to replace mmap().
  */
-#define putchar test_seam_putchar
+#define mmap test_seam_mmap
+
+/**
+ * Inject a test seam to replace munmap().
+ */
+#define munmap test_seam_munmap
+
+/**
+ * Inject a test seam to replace pthread_create().
+ */
+#define pthread_create test_seam_pthread_create
+
+/**
+ * Inject a test seam to replace pread().
+ */
+#define pread test_seam_pread
+
+/**
+ * Inject a test seam to replace read().
+ */
+#define read test_seam_read
+
+/**
+ * Inject a test seam to replace realloc().
+ */
+#define realloc test_seam_realloc
+
+/**
+ * Inject a test seam to replace sendfile().
+ */
+#define sendfile test_seam_sendfile
+
+/**
+ * Inject a test seam to replace splice().
+ */
+#define splice test_seam_splice
+
+/**
+ * Inject a test seam to replace syscall().
+ */
+#define syscall test_seam_syscall
+
+/**
+ * Inject a test seam to replace writev().
+ */
+#define writev test_seam_writev
 
 #endif /* HEAD_TEST_SEAMS_H */
 
@@ -6,13 +6,21 @@
  * This software has been placed into the public domain using CC0.
  */
 
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "test.h"
@@ -22,6 +30,48 @@
  */
 #define PATH_TMP_FILE "build/test-head.txt"
 
+/**
+ * Receives the (--stats) report of @ref test_head_stats.
+ */
+#define PATH_STATS_FILE "build/test-stats.json"
+
+/**
+ * Reference output produced by the worker pool, compared against the
+ * output of the serial and io_uring paths.
+ */
+#define PATH_REF_FILE "build/test-ref.txt"
+
+/**
+ * Socket of the server started by @ref test_serve_start.
+ */
+#define PATH_SERVE_SOCK "build/test-serve.sock"
+
+/**
+ * File type connected to STDOUT of the utility.
+ */
+enum test_stdout{
+  /**
+   * Write directly to @ref PATH_TMP_FILE.
+   */
+  TEST_STDOUT_FILE,
+
+  /**
+   * Write to a pipe copied to @ref PATH_TMP_FILE.
+   */
+  TEST_STDOUT_PIPE,
+
+  /**
+   * Write to a stream socket copied to @ref PATH_TMP_FILE.
+   */
+  TEST_STDOUT_SOCKET
+};
+
+/**
+ * STDOUT file type used by @ref test_head_main.
+ */
+static enum test_stdout
+g_test_stdout = TEST_STDOUT_FILE;
+
 /**
  * Number of arguments in @ref g_argv.
  */
@@ -62,7 +112,10 @@ test_head_main(const char *const nlines,
   int status;
   int cmp_exit_status;
   int pipe_stdin[2];
+  int pipe_stdout[2];
+  ssize_t bytes_read;
   char cmp_cmd[1000];
+  char out_buf[1000];
 
   g_argc = 1;
   if(nlines){
@@ -82,6 +135,12 @@ test_head_main(const char *const nlines,
   if(stdin_bytes){
     assert(pipe(pipe_stdin) == 0);
   }
+  if(g_test_stdout == TEST_STDOUT_PIPE){
+    assert(pipe(pipe_stdout) == 0);
+  }
+  else if(g_test_stdout == TEST_STDOUT_SOCKET){
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pipe_stdout) == 0);
+  }
 
   pid = fork();
   assert(pid >= 0);
@@ -91,8 +150,15 @@ test_head_main(const char *const nlines,
       assert(dup2(pipe_stdin[0], STDIN_FILENO) >= 0);
       assert(close(pipe_stdin[0]) == 0);
     }
-    new_stdout = freopen(PATH_TMP_FILE, "w", stdout);
-    assert(new_stdout);
+    if(g_test_stdout == TEST_STDOUT_FILE){
+      new_stdout = freopen(PATH_TMP_FILE, "w", stdout);
+      assert(new_stdout);
+    }
+    else{
+      assert(close(pipe_stdout[0]) == 0);
+      assert(dup2(pipe_stdout[1], STDOUT_FILENO) >= 0);
+      assert(close(pipe_stdout[1]) == 0);
+    }
     exit_status = head_main(g_argc, g_argv);
     exit(exit_status);
   }
@@ -102,6 +168,18 @@ test_head_main(const char *const nlines,
     assert(bytes_written >= 0 && (size_t)bytes_written == stdin_bytes_len);
     assert(close(pipe_stdin[1]) == 0);
   }
+  if(g_test_stdout != TEST_STDOUT_FILE){
+    assert(close(pipe_stdout[1]) == 0);
+    new_stdout = fopen(PATH_TMP_FILE, "w");
+    assert(new_stdout);
+    while((bytes_read = read(pipe_stdout[0], out_buf, sizeof(out_buf))) > 0){
+      assert(fwrite(out_buf, 1, (size_t)bytes_read, new_stdout) ==
+             (size_t)bytes_read);
+    }
+    assert(bytes_read == 0);
+    assert(fclose(new_stdout) == 0);
+    assert(close(pipe_stdout[0]) == 0);
+  }
   assert(waitpid(pid, &status, 0) == pid);
   assert(WIFEXITED(status));
   assert(WEXITSTATUS(status) == expect_exit_status);
@@ -113,226 +191,2890 @@ test_head_main(const char *const nlines,
 }
 
 /**
- * Test different failure scenarios.
+ * Check the offset that @ref head_main leaves in a file read from STDIN.
+ *
+ * The file description gets shared with the child process, like a shell
+ * running head and another command on the same redirected input.
+ *
+ * @param[in] count              Argument passed to (-n), or to (-c) if
+ *                               @p bytes set.
+ * @param[in] bytes              Count bytes instead of lines.
+ * @param[in] path               File connected to STDIN.
+ * @param[in] expect_off         Expected file offset after head exits.
+ * @param[in] expect_exit_status Expected exit status code.
  */
 static void
-test_all_errors(void){
-  int i;
+test_head_stdin_offset(const char *const count,
+                       const bool bytes,
+                       const char *const path,
+                       const off_t expect_off,
+                       const int expect_exit_status){
+  pid_t pid;
+  int fd;
+  int status;
+  FILE *new_stdout;
 
-  /* Invalid argument. */
-  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "-z", NULL);
+  g_argc = 1;
+  strcpy(g_argv[g_argc++], bytes ? "-c" : "-n");
+  strcpy(g_argv[g_argc++], count);
+  fd = open(path, O_RDONLY);
+  assert(fd >= 0);
+  pid = fork();
+  assert(pid >= 0);
+  if(pid == 0){
+    assert(dup2(fd, STDIN_FILENO) >= 0);
+    assert(close(fd) == 0);
+    new_stdout = freopen(PATH_TMP_FILE, "w", stdout);
+    assert(new_stdout);
+    exit(head_main(g_argc, g_argv));
+  }
+  assert(waitpid(pid, &status, 0) == pid);
+  assert(WIFEXITED(status));
+  assert(WEXITSTATUS(status) == expect_exit_status);
+  assert(lseek(fd, 0, SEEK_CUR) == expect_off);
+  assert(close(fd) == 0);
+}
 
-  /* Blank nlines. */
-  test_head_main("", NULL, 0, NULL, EXIT_FAILURE, NULL);
+/**
+ * Leave a seekable STDIN positioned right after the printed lines or bytes.
+ */
+static void
+test_all_stdin_offset(void){
+  struct stat sb;
 
-  /* Invalid nlines character. */
-  test_head_main("9f", NULL, 0, NULL, EXIT_FAILURE, NULL);
+  assert(stat("test/files/5.txt", &sb) == 0);
+  test_head_stdin_offset("5",
+                         false,
+                         "test/files/10.txt",
+                         sb.st_size,
+                         EXIT_SUCCESS);
+  test_head_stdin_offset("7", true, "test/files/10.txt", 7, EXIT_SUCCESS);
 
-  /* nlines too large (assume unsigned 64 bit). */
-  test_head_main("18446744073709551616", NULL, 0, NULL, EXIT_FAILURE, NULL);
+  assert(stat("test/files/10.txt", &sb) == 0);
+  test_head_stdin_offset("100",
+                         false,
+                         "test/files/10.txt",
+                         sb.st_size,
+                         EXIT_SUCCESS);
 
-  /* File does not exist. */
-  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "/noexist.txt", NULL);
+  /* Last line spans multiple blocks. */
+  assert(stat("build/test-seq.txt.50000", &sb) == 0);
+  test_head_stdin_offset("50000",
+                         false,
+                         "build/test-seq.txt",
+                         sb.st_size,
+                         EXIT_SUCCESS);
 
-  /* Failed to getline. */
-  g_test_seam_err_ctr_getline = 0;
-  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "README.md", NULL);
-  g_test_seam_err_ctr_getline = -1;
+  /* Failed to restore the offset. */
+  g_test_seam_err_ctr_lseek = 0;
+  assert(stat("test/files/10.txt", &sb) == 0);
+  test_head_stdin_offset("5",
+                         false,
+                         "test/files/10.txt",
+                         sb.st_size,
+                         EXIT_FAILURE);
+  g_test_seam_err_ctr_lseek = -1;
+}
 
-  /* Failed to fwrite file. */
-  g_test_seam_err_ctr_fwrite = 0;
-  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "README.md", NULL);
-  g_test_seam_err_ctr_fwrite = -1;
+/**
+ * Check the (--stats) report written by @ref head_main.
+ *
+ * The report goes to a file opened before forking the utility, so that the
+ * child process inherits its file descriptor.
+ *
+ * @param[in] nlines             Number of initial lines to write.
+ * @param[in] stdin_bytes        Transmit this string to STDIN, or NULL.
+ * @param[in] expect_exit_status Expected exit status code.
+ * @param[in] expect             Text expected in the report.
+ * @param[in] arg1               Argument after (--stats), or NULL.
+ * @param[in] arg2               Argument after @p arg1, or NULL.
+ * @param[in] arg3               Argument after @p arg2, or NULL.
+ */
+static void
+test_head_stats(const char *const nlines,
+                const char *const stdin_bytes,
+                const int expect_exit_status,
+                const char *const expect,
+                const char *const arg1,
+                const char *const arg2,
+                const char *const arg3){
+  char arg[100];
+  char buf[4096];
+  ssize_t len;
+  int fd;
 
-  /* File error indicator set. */
-  for(i = 0; i < 2; i++){
-    g_test_seam_err_ctr_ferror = i;
-    test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "README.md", NULL);
-    g_test_seam_err_ctr_ferror = -1;
-  }
+  fd = open(PATH_STATS_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  assert(fd >= 0);
+  sprintf(arg, "--stats=%d", fd);
+  test_head_main(nlines,
+                 stdin_bytes,
+                 stdin_bytes ? strlen(stdin_bytes) : 0,
+                 NULL,
+                 expect_exit_status,
+                 arg,
+                 arg1,
+                 arg2,
+                 arg3,
+                 NULL);
+  len = pread(fd, buf, sizeof(buf) - 1, 0);
+  assert(len > 0);
+  buf[len] = '\0';
+  assert(close(fd) == 0);
+  assert(strncmp(buf, "{\"files\":[\n", 11) == 0);
+  assert(strstr(buf, "\n],\n\"total\":{\"engines\":["));
+  assert(strcmp(buf + len - 3, "}}\n") == 0);
+  assert(strstr(buf, expect));
+}
 
-  /* Failed to fclose file. */
-  g_test_seam_err_ctr_fclose = 0;
-  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "README.md", NULL);
-  g_test_seam_err_ctr_fclose = -1;
+/**
+ * Write bytes to a file.
+ *
+ * @param[in] path File to create.
+ * @param[in] buf  Bytes to write.
+ * @param[in] len  Number of bytes in @p buf.
+ */
+static void
+test_write_file(const char *const path,
+                const char *const buf,
+                const size_t len){
+  FILE *fp;
 
-  /* Failed to print banner. */
-  g_test_seam_err_ctr_printf = 0;
-  test_head_main(NULL,
+  fp = fopen(path, "w");
+  assert(fp);
+  assert(fwrite(buf, 1, len, fp) == len);
+  assert(fclose(fp) == 0);
+}
+
+/**
+ * Run all test cases for the (--stats) report.
+ */
+static void
+test_all_stats(void){
+  char arg[100];
+  int fd;
+
+  test_head_stats("3",
+                  NULL,
+                  EXIT_SUCCESS,
+                  "{\"name\":\"test/files/10.txt\","
+                  "\"engines\":[\"mmap\",\"copy_file_range\"],",
+                  "test/files/10.txt",
+                  NULL,
+                  NULL);
+  test_head_stats("3",
+                  NULL,
+                  EXIT_SUCCESS,
+                  "\"lines\":3,",
+                  "test/files/10.txt",
+                  NULL,
+                  NULL);
+  test_head_stats("2",
+                  "a\nb\nc\n",
+                  EXIT_SUCCESS,
+                  "{\"name\":\"stdin\",\"engines\":[\"read\"],"
+                  "\"bytes_read\":6,\"bytes_written\":4,\"lines\":2,"
+                  "\"reads\":1,\"writes\":1,",
+                  NULL,
+                  NULL,
+                  NULL);
+
+  /* File name that is not valid UTF-8. */
+  test_write_file("build/test-\xff\xc3.txt", "a\n", 2);
+  test_head_stats("1",
+                  NULL,
+                  EXIT_SUCCESS,
+                  "{\"name\":\"build/test-\\u00ff\\u00c3.txt\",",
+                  "build/test-\xff\xc3.txt",
+                  NULL,
+                  NULL);
+
+  /* Lines not counted when printing the whole file or bytes. */
+  test_head_stats("1000",
+                  NULL,
+                  EXIT_SUCCESS,
+                  "\"lines\":null,",
+                  "test/files/10.txt",
+                  NULL,
+                  NULL);
+  test_head_stats(NULL,
+                  NULL,
+                  EXIT_SUCCESS,
+                  "\"lines\":null,",
+                  "-c5",
+                  "test/files/10.txt",
+                  NULL);
+
+  /* Totals over multiple files and the quoted file name. */
+  test_head_stats("3",
+                  NULL,
+                  EXIT_FAILURE,
+                  "{\"name\":\"no\\\"exist\\u0001\",\"engines\":[],",
+                  "test/files/10.txt",
+                  "no\"exist\001",
+                  NULL);
+  test_head_stats("3",
+                  NULL,
+                  EXIT_SUCCESS,
+                  "\"total\":{\"engines\":[\"mmap\"],\"bytes_read\":60,",
+                  "test/files/10.txt",
+                  "test/files/10.txt",
+                  NULL);
+#ifdef HEAD_ZLIB
+  test_head_stats("3",
+                  NULL,
+                  EXIT_SUCCESS,
+                  "\"engines\":[\"gzip\"],",
+                  "--decompress",
+                  "test/files/10.txt.gz",
+                  NULL);
+#endif /* HEAD_ZLIB */
+
+  /* Worker pool reports the files in argument order. */
+  test_head_stats("3",
+                  NULL,
+                  EXIT_SUCCESS,
+                  "{\"name\":\"test/files/5.txt\",\"engines\":[\"mmap\"],",
+                  "-j2",
+                  "test/files/5.txt",
+                  "test/files/10.txt");
+
+  /* Report to STDERR. */
+  test_head_main("3",
+                 NULL,
+                 0,
+                 "test/files/3.txt",
+                 EXIT_SUCCESS,
+                 "--stats",
+                 "test/files/10.txt",
+                 NULL);
+
+  /* Invalid or closed file descriptor. */
+  test_head_main("3",
                  NULL,
                  0,
                  NULL,
                  EXIT_FAILURE,
-                 "README.md",
-                 "README.md",
+                 "--stats=x",
+                 "test/files/10.txt",
                  NULL);
-  g_test_seam_err_ctr_printf = -1;
-
-  /* Failed to print newline before banner. */
-  g_test_seam_err_ctr_putchar = 0;
-  test_head_main(NULL,
+  test_head_main("3",
                  NULL,
                  0,
                  NULL,
                  EXIT_FAILURE,
-                 "README.md",
-                 "README.md",
+                 "--stats=99",
+                 "test/files/10.txt",
                  NULL);
-  g_test_seam_err_ctr_putchar = -1;
 
-  /* First file does not exist. */
-  test_head_main(NULL,
+  /* File descriptor not open for writing. */
+  fd = open("test/files/10.txt", O_RDONLY);
+  assert(fd >= 0);
+  sprintf(arg, "--stats=%d", fd);
+  test_head_main("3",
                  NULL,
                  0,
-                 "test/files/comb-noexist-1.txt",
+                 NULL,
                  EXIT_FAILURE,
-                 "/noexist.txt",
-                 "test/files/1.txt",
+                 arg,
+                 "test/files/10.txt",
                  NULL);
+  assert(close(fd) == 0);
 
-  /* Second file does not exist. */
-  test_head_main(NULL,
+  /* Failed to write the report. */
+  fd = open("/dev/full", O_WRONLY);
+  assert(fd >= 0);
+  sprintf(arg, "--stats=%d", fd);
+  test_head_main("3",
                  NULL,
                  0,
-                 "test/files/comb-1-noexist.txt",
+                 "test/files/3.txt",
                  EXIT_FAILURE,
-                 "test/files/1.txt",
-                 "/noexist.txt",
+                 arg,
+                 "test/files/10.txt",
                  NULL);
+  assert(close(fd) == 0);
 }
 
 /**
- * Run test cases where we send data through STDIN.
+ * Check the bytes collected by @ref head_sink_buf against a file.
+ *
+ * @param[in,out] hbuf     Output buffer, emptied for the next test.
+ * @param[in]     ref_file Reference file containing expected output.
  */
 static void
-test_all_stdin(void){
-  const char *const stdin_bytes =
-  "1: line 1\n"
-  "2: line 2\n"
-  "3: line 3\n"
-  "4: line 4\n"
-  "5: line 5\n";
-  size_t stdin_bytes_len;
+test_lib_cmp(struct head_buf *const hbuf,
+             const char *const ref_file){
+  char ref[1000];
+  FILE *fp;
+  size_t len;
 
-  stdin_bytes_len = strlen(stdin_bytes);
+  fp = fopen(ref_file, "r");
+  assert(fp);
+  len = fread(ref, 1, sizeof(ref), fp);
+  assert(fclose(fp) == 0);
+  assert(hbuf->len == len);
+  assert(memcmp(hbuf->data, ref, len) == 0);
+  hbuf->len = 0;
+}
 
-  /* Use STDIN. */
-  test_head_main(NULL,
-                 stdin_bytes,
-                 stdin_bytes_len,
-                 "test/files/5.txt",
-                 EXIT_SUCCESS,
-                 NULL);
+/**
+ * Print through the library interface, reusing one context.
+ */
+static void
+test_all_lib(void){
+  const char *const mem = "a\nb\nc";
+  char data[1000];
+  struct head_buf hbuf;
+  struct head *head;
+  struct stat sb;
+  FILE *fp;
+  int fd;
 
-  /* Fail to read from STDIN. */
-  g_test_seam_err_ctr_getline = 0;
-  test_head_main(NULL,
-                 stdin_bytes,
-                 stdin_bytes_len,
-                 NULL,
-                 EXIT_FAILURE,
-                 NULL);
-  g_test_seam_err_ctr_getline = -1;
+  /* Failed to allocate context. */
+  g_test_seam_err_ctr_malloc = 0;
+  assert(head_new() == NULL);
+  g_test_seam_err_ctr_malloc = -1;
+
+  head = head_new();
+  assert(head);
+  hbuf.data = data;
+  hbuf.size = sizeof(data);
+  hbuf.len = 0;
+  head_set_sink(head, head_sink_buf, &hbuf);
+
+  /* Memory buffer. */
+  head_set_lines(head, 2, false);
+  assert(head_print_mem(head, mem, strlen(mem)) == 0);
+  assert(hbuf.len == 4 && memcmp(data, "a\nb\n", 4) == 0);
+  hbuf.len = 0;
+  head_set_bytes(head, 3, false);
+  assert(head_print_mem(head, mem, strlen(mem)) == 0);
+  assert(hbuf.len == 3 && memcmp(data, "a\nb", 3) == 0);
+  hbuf.len = 0;
+  head_set_lines(head, 1, true);
+  assert(head_print_mem(head, mem, strlen(mem)) == 0);
+  assert(hbuf.len == 4 && memcmp(data, "a\nb\n", 4) == 0);
+  hbuf.len = 0;
+  head_set_lines(head, 5, true);
+  assert(head_print_mem(head, mem, strlen(mem)) == 0);
+  assert(hbuf.len == 0);
+  head_set_bytes(head, 4, true);
+  assert(head_print_mem(head, mem, strlen(mem)) == 0);
+  assert(hbuf.len == 1 && data[0] == 'a');
+  hbuf.len = 0;
+
+  /* Lines ending with a NUL byte. */
+  head_set_delim(head, '\0');
+  head_set_lines(head, 2, false);
+  assert(head_print_mem(head, "a\0b\0c", 5) == 0);
+  assert(hbuf.len == 4 && memcmp(data, "a\0b\0", 4) == 0);
+  hbuf.len = 0;
+  head_set_delim(head, '\n');
+
+  /* File descriptor. */
+  head_set_lines(head, 5, false);
+  fd = open("test/files/10.txt", O_RDONLY);
+  assert(fd >= 0);
+  assert(head_print_fd(head, fd, "10.txt") == 0);
+  assert(close(fd) == 0);
+  test_lib_cmp(&hbuf, "test/files/5.txt");
+
+  /* Stream left positioned after the printed lines. */
+  fp = fopen("test/files/10.txt", "r");
+  assert(fp);
+  assert(head_print_fp(head, fp, "10.txt") == 0);
+  assert(stat("test/files/5.txt", &sb) == 0);
+  assert(ftello(fp) == sb.st_size);
+  assert(fclose(fp) == 0);
+  test_lib_cmp(&hbuf, "test/files/5.txt");
 
+  /* Stream holding back the last lines. */
+  head_set_lines(head, 5, true);
+  fp = fopen("test/files/10.txt", "r");
+  assert(fp);
+  assert(head_print_fp(head, fp, "10.txt") == 0);
+  assert(fclose(fp) == 0);
+  test_lib_cmp(&hbuf, "test/files/5.txt");
+
+  /* Holding back no line or byte prints everything. */
+  head_set_lines(head, 0, true);
+  assert(head_print_mem(head, "a\nb\n", 4) == 0);
+  assert(hbuf.len == 4 && memcmp(data, "a\nb\n", 4) == 0);
+  hbuf.len = 0;
+  head_set_bytes(head, 0, true);
+  assert(head_print_mem(head, "a\nb\n", 4) == 0);
+  assert(hbuf.len == 4 && memcmp(data, "a\nb\n", 4) == 0);
+  hbuf.len = 0;
+  head_set_lines(head, 0, true);
+  fd = open("test/files/5.txt", O_RDONLY);
+  assert(fd >= 0);
+  assert(head_print_fd(head, fd, "5.txt") == 0);
+  assert(close(fd) == 0);
+  test_lib_cmp(&hbuf, "test/files/5.txt");
+  assert(head_print_path(head, "test/files/5.txt") == 0);
+  test_lib_cmp(&hbuf, "test/files/5.txt");
+
+  /* Failed to read stream. */
+  fp = fopen("test/files", "r");
+  assert(fp);
+  assert(head_print_fp(head, fp, "test/files") == -1);
+  assert(fclose(fp) == 0);
+
+  /* Failed to allocate block buffer for a stream. */
+  head_free(head);
+  head = head_new();
+  assert(head);
+  head_set_sink(head, head_sink_buf, &hbuf);
+  g_test_seam_err_ctr_malloc = 0;
+  assert(head_print_fp(head, stdin, "stdin") == -1);
+  g_test_seam_err_ctr_malloc = -1;
+
+  /* File path. */
+  head_set_bytes(head, 12, false);
+  assert(head_print_path(head, "test/files/10.txt") == 0);
+  test_lib_cmp(&hbuf, "test/files/c-12.txt");
+  assert(head_print_path(head, "/noexist.txt") == -1);
+
+  /* Output buffer too small. */
+  hbuf.size = 3;
+  assert(head_print_path(head, "test/files/10.txt") == -1);
+  assert(hbuf.len == 3);
+  hbuf.len = 0;
+
+  /* Back to STDOUT. */
+  head_set_sink(head, NULL, NULL);
+  head_set_bytes(head, 0, false);
+  assert(head_print_path(head, "test/files/10.txt") == 0);
+  head_free(head);
+  head_free(NULL);
 }
 
 /**
- * Run all test cases for the head utility.
+ * Get the peak memory use of @ref head_main printing the first line of a
+ * file.
+ *
+ * @param[in] path      File to print.
+ * @param[in] use_stdin Send @p path through a pipe connected to STDIN
+ *                      instead of passing it as an argument.
+ * @return              Maximum resident set size in kilobytes.
+ */
+static long
+test_head_maxrss(const char *const path,
+                 const bool use_stdin){
+  pid_t pid;
+  int status;
+  int pipe_stdin[2];
+  FILE *fp;
+  FILE *new_stdout;
+  size_t nread;
+  struct rusage ru;
+  char buf[4096];
+
+  g_argc = 1;
+  strcpy(g_argv[g_argc++], "-n");
+  strcpy(g_argv[g_argc++], "1");
+  if(!use_stdin){
+    strcpy(g_argv[g_argc++], path);
+  }
+  assert(pipe(pipe_stdin) == 0);
+  pid = fork();
+  assert(pid >= 0);
+  if(pid == 0){
+    assert(close(pipe_stdin[1]) == 0);
+    assert(dup2(pipe_stdin[0], STDIN_FILENO) >= 0);
+    assert(close(pipe_stdin[0]) == 0);
+    new_stdout = freopen("/dev/null", "w", stdout);
+    assert(new_stdout);
+    exit(head_main(g_argc, g_argv));
+  }
+  assert(close(pipe_stdin[0]) == 0);
+  if(use_stdin){
+    fp = fopen(path, "r");
+    assert(fp);
+    while((nread = fread(buf, 1, sizeof(buf), fp)) > 0){
+      assert(write(pipe_stdin[1], buf, nread) == (ssize_t)nread);
+    }
+    assert(fclose(fp) == 0);
+  }
+  assert(close(pipe_stdin[1]) == 0);
+  assert(wait4(pid, &status, 0, &ru) == pid);
+  assert(WIFEXITED(status));
+  assert(WEXITSTATUS(status) == EXIT_SUCCESS);
+  return ru.ru_maxrss;
+}
+
+/**
+ * Make sure a file without any newline does not get loaded into memory.
+ *
+ * The long line file holds twice the mapping window of the utility without
+ * a newline. Compared to printing a short file, the peak memory use may
+ * grow by at most one mapping window plus some slack.
  */
 static void
-test_all(void){
-  test_head_main(NULL,
+test_all_long_line(void){
+  const char *const path = "build/test-long-line.txt";
+  const long slack_kb = 4 * 1024;
+  long max_growth_kb;
+  long base_kb;
+  long long_kb;
+  struct stat sb;
+  int i;
+
+  assert(stat(path, &sb) == 0);
+  assert((size_t)sb.st_size >= 2 * g_head_mmap_window);
+  max_growth_kb = (long)(g_head_mmap_window / 1024) + slack_kb;
+  assert(max_growth_kb < (long)(sb.st_size / 1024));
+  for(i = 0; i < 2; i++){
+    base_kb = test_head_maxrss("test/files/1.txt", i == 1);
+    long_kb = test_head_maxrss(path, i == 1);
+    assert(long_kb - base_kb < max_growth_kb);
+  }
+}
+
+/**
+ * Print many lines from a file using the line-offset index.
+ *
+ * Builds the index, reuses it, extends it, and rebuilds it after it goes
+ * stale or gets corrupted.
+ */
+static void
+test_all_index(void){
+  const char *const path = "build/test-seq.txt";
+  const char *const index_dir = "--index-dir=build/index";
+  char index_path[100];
+  struct stat sb;
+  uint64_t off;
+  FILE *fp;
+  int fd;
+  int i;
+
+  assert(mkdir("build/index", 0755) == 0 || errno == EEXIST);
+  assert(stat(path, &sb) == 0);
+  sprintf(index_path,
+          "build/index/%lx-%lx.idx",
+          (unsigned long)sb.st_dev,
+          (unsigned long)sb.st_ino);
+  unlink(index_path);
+
+  /* Build the index, then use it. */
+  for(i = 0; i < 2; i++){
+    test_head_main("20000",
+                   NULL,
+                   0,
+                   "build/test-seq.txt.20000",
+                   EXIT_SUCCESS,
+                   index_dir,
+                   path,
+                   NULL);
+    assert(stat(index_path, &sb) == 0);
+  }
+
+  /* Extend the index. */
+  test_head_main("50000",
                  NULL,
                  0,
-                 "test/files/10.txt",
+                 "build/test-seq.txt.50000",
                  EXIT_SUCCESS,
-                 "test/files/10.txt",
+                 index_dir,
+                 path,
                  NULL);
 
-  test_head_main(NULL,
+  /* Index covers the whole file. */
+  for(i = 0; i < 2; i++){
+    test_head_main("200000",
+                   NULL,
+                   0,
+                   path,
+                   EXIT_SUCCESS,
+                   index_dir,
+                   path,
+                   NULL);
+  }
+
+  /* Index goes stale after the file gets modified. */
+  assert(utimensat(AT_FDCWD, path, NULL, 0) == 0);
+  test_head_main("20000",
                  NULL,
                  0,
-                 "test/files/comb-5-1.txt",
+                 "build/test-seq.txt.20000",
                  EXIT_SUCCESS,
-                 "test/files/5.txt",
-                 "test/files/1.txt",
+                 index_dir,
+                 path,
                  NULL);
 
-  test_head_main(NULL,
+  /* Corrupted index. */
+  fp = fopen(index_path, "w");
+  assert(fp);
+  assert(fputs("corrupt", fp) >= 0);
+  assert(fclose(fp) == 0);
+  test_head_main("50000",
                  NULL,
                  0,
-                 "test/files/comb-1-10-1.txt",
+                 "build/test-seq.txt.50000",
                  EXIT_SUCCESS,
-                 "test/files/1.txt",
-                 "test/files/10.txt",
-                 "test/files/1.txt",
+                 index_dir,
+                 path,
                  NULL);
 
-  /* Print out 5 out of 10 lines in the input file. */
-  test_head_main("5",
+  /* Index with a valid header but offsets out of order or past the end of
+   * the file. */
+  for(i = 0; i < 2; i++){
+    assert(stat(index_path, &sb) == 0);
+    off = (i == 0) ? UINT64_MAX : 1;
+    fd = open(index_path, O_WRONLY);
+    assert(fd >= 0);
+    assert(pwrite(fd, &off, sizeof(off), sb.st_size - (off_t)sizeof(off)) ==
+           (ssize_t)sizeof(off));
+    assert(close(fd) == 0);
+    test_head_main("50000",
+                   NULL,
+                   0,
+                   "build/test-seq.txt.50000",
+                   EXIT_SUCCESS,
+                   index_dir,
+                   path,
+                   NULL);
+    fd = open(index_path, O_RDONLY);
+    assert(fd >= 0);
+    assert(fstat(fd, &sb) == 0);
+    assert(pread(fd, &off, sizeof(off), sb.st_size - (off_t)sizeof(off)) ==
+           (ssize_t)sizeof(off));
+    assert(close(fd) == 0);
+    assert(off > 1 && off < UINT64_MAX);
+  }
+
+  /* Failed to map the file while building the index. */
+  unlink(index_path);
+  g_test_seam_err_ctr_mmap = 0;
+  test_head_main("20000",
                  NULL,
                  0,
-                 "test/files/5.txt",
+                 "build/test-seq.txt.20000",
                  EXIT_SUCCESS,
-                 "test/files/10.txt",
+                 index_dir,
+                 path,
                  NULL);
+  g_test_seam_err_ctr_mmap = -1;
 
-  /* Print 0 lines from the input file. */
-  test_head_main("0",
+  /* Failed to grow the index while building it. */
+  g_test_seam_err_ctr_realloc = 0;
+  test_head_main("20000",
                  NULL,
                  0,
-                 "test/files/0.txt",
+                 "build/test-seq.txt.20000",
                  EXIT_SUCCESS,
-                 "test/files/10.txt",
+                 index_dir,
+                 path,
                  NULL);
+  g_test_seam_err_ctr_realloc = -1;
 
-  /* Print only 10 lines with higer nlimit. */
-  test_head_main("100",
+  /* Failed to write the index. */
+  g_test_seam_err_ctr_writev = 0;
+  test_head_main("20000",
                  NULL,
                  0,
-                 "test/files/10.txt",
+                 "build/test-seq.txt.20000",
                  EXIT_SUCCESS,
-                 "test/files/10.txt",
+                 index_dir,
+                 path,
                  NULL);
+  g_test_seam_err_ctr_writev = -1;
 
-  /* Combine two 5-line outputs from 10 line file. */
-  test_head_main("5",
+  /* Failed to create the index. */
+  test_head_main("20000",
                  NULL,
                  0,
-                 "test/files/comb-10-10_5.txt",
+                 "build/test-seq.txt.20000",
                  EXIT_SUCCESS,
-                 "test/files/10.txt",
-                 "test/files/10.txt",
+                 "--index-dir=/noexist",
+                 path,
                  NULL);
 
-  /* 98 lines from random file. */
-  test_head_main("98",
+  /* Many file operands still use the index. */
+  unlink(index_path);
+  test_head_main("20000",
                  NULL,
                  0,
-                 "build/test-rand.txt.98",
+                 NULL,
                  EXIT_SUCCESS,
-                 "build/test-rand.txt",
+                 "-j",
+                 "2",
+                 path,
+                 path,
+                 path,
+                 path,
+                 path,
+                 path,
+                 path,
+                 path,
                  NULL);
-
-  /* Maximum allowed nlines value (assume unsigned 64 bit). */
-  test_head_main("18446744073709551615",
+  assert(rename(PATH_TMP_FILE, PATH_REF_FILE) == 0);
+  test_head_main("20000",
                  NULL,
                  0,
-                 "build/test-rand.txt",
+                 PATH_REF_FILE,
                  EXIT_SUCCESS,
-                 "build/test-rand.txt",
+                 index_dir,
+                 path,
+                 path,
+                 path,
+                 path,
+                 path,
+                 path,
+                 path,
+                 path,
                  NULL);
+  assert(stat(index_path, &sb) == 0);
+  assert(unlink(PATH_REF_FILE) == 0);
+}
 
-  /* File without ending newline. */
-  test_head_main(NULL,
-                 NULL,
-                 0,
-                 "test/files/5-no-eol.txt",
-                 EXIT_SUCCESS,
-                 "test/files/5-no-eol.txt",
+/**
+ * Compare the delimiter scanning kernels against each other.
+ *
+ * The scalar kernel also gets checked against a byte-by-byte search.
+ *
+ * @param[in] buf    Buffer to search.
+ * @param[in] len    Number of bytes in @p buf.
+ * @param[in] delim  Record delimiter.
+ * @param[in] nlines Number of records to find.
+ */
+static void
+test_scan_cmp(const char *const buf,
+              const size_t len,
+              const int delim,
+              const uintmax_t nlines){
+  uintmax_t expect_nlines;
+  uintmax_t scan_nlines;
+  size_t expect_len;
+  size_t scan_len;
+  size_t i;
+
+  expect_nlines = nlines;
+  for(expect_len = 0; expect_nlines > 0 && expect_len < len; expect_len++){
+    if(buf[expect_len] == (char)delim){
+      expect_nlines -= 1;
+    }
+  }
+
+  scan_nlines = nlines;
+  scan_len = head_scan_scalar(buf, len, delim, &scan_nlines);
+  assert(scan_len == expect_len);
+  assert(scan_nlines == expect_nlines);
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  scan_nlines = nlines;
+  scan_len = head_scan_sse2(buf, len, delim, &scan_nlines);
+  assert(scan_len == expect_len);
+  assert(scan_nlines == expect_nlines);
+
+  if(__builtin_cpu_supports("avx2")){
+    scan_nlines = nlines;
+    scan_len = head_scan_avx2(buf, len, delim, &scan_nlines);
+    assert(scan_len == expect_len);
+    assert(scan_nlines == expect_nlines);
+  }
+#endif /* __GNUC__ && (__x86_64__ || __i386__) */
+
+  expect_nlines = nlines;
+  expect_len = (nlines == 0) ? len : 0;
+  for(i = len; expect_nlines > 0 && i > 0; i--){
+    if(buf[i - 1] == (char)delim){
+      expect_nlines -= 1;
+      if(expect_nlines == 0){
+        expect_len = i;
+      }
+    }
+  }
+  scan_nlines = nlines;
+  scan_len = head_rscan(buf, len, delim, &scan_nlines);
+  assert(scan_len == expect_len);
+  assert(scan_nlines == expect_nlines);
+}
+
+/**
+ * Run the delimiter scanning kernels over a buffer at every alignment,
+ * requesting every possible number of records.
+ *
+ * @param[in] buf   Buffer to search.
+ * @param[in] len   Number of bytes in @p buf.
+ * @param[in] delim Record delimiter.
+ */
+static void
+test_scan_buf(const char *const buf,
+              const size_t len,
+              const int delim){
+  size_t off;
+  size_t i;
+  uintmax_t ndelim;
+  uintmax_t nlines;
+
+  for(off = 0; off < 64 && off <= len; off++){
+    ndelim = 0;
+    for(i = off; i < len; i++){
+      if(buf[i] == (char)delim){
+        ndelim += 1;
+      }
+    }
+    for(nlines = 0; nlines <= ndelim + 1; nlines++){
+      test_scan_cmp(&buf[off], len - off, delim, nlines);
+    }
+    test_scan_cmp(&buf[off], len - off, delim, UINTMAX_MAX);
+  }
+}
+
+/**
+ * Test the delimiter scanning kernels on random data.
+ */
+static void
+test_all_scan(void){
+  const size_t len_list[] = {0, 1, 15, 16, 31, 32, 33, 63, 64, 65, 127, 1000};
+  const unsigned int density_list[] = {1, 2, 7, 64, 1000};
+  char buf[1100];
+  size_t i;
+  size_t j;
+  size_t k;
+  char *rand_buf;
+  struct stat sb;
+  FILE *fp;
+
+  srand(1);
+  for(i = 0; i < sizeof(density_list) / sizeof(*density_list); i++){
+    for(j = 0; j < sizeof(len_list) / sizeof(*len_list); j++){
+      for(k = 0; k < sizeof(buf); k++){
+        if((unsigned int)rand() % density_list[i] == 0){
+          buf[k] = '\n';
+        }
+        else{
+          buf[k] = (char)rand();
+        }
+      }
+      test_scan_buf(buf, len_list[j], '\n');
+      test_scan_buf(buf, len_list[j], '\0');
+    }
+  }
+
+  assert(stat("build/test-rand.txt", &sb) == 0);
+  rand_buf = malloc((size_t)sb.st_size);
+  assert(rand_buf);
+  fp = fopen("build/test-rand.txt", "r");
+  assert(fp);
+  assert(fread(rand_buf, 1, (size_t)sb.st_size, fp) == (size_t)sb.st_size);
+  assert(fclose(fp) == 0);
+  for(i = 0; i <= 101; i++){
+    test_scan_cmp(rand_buf, (size_t)sb.st_size, '\n', i);
+    test_scan_cmp(rand_buf, (size_t)sb.st_size, '\0', i);
+    test_scan_cmp(rand_buf, (size_t)sb.st_size, 0xff, i);
+  }
+  free(rand_buf);
+}
+
+/**
+ * Run all test cases for lines ending with another byte than a newline.
+ */
+static void
+test_all_delim(void){
+  const char nul_10[] = "1\0" "2\0" "3\0" "4\0" "5\0"
+                        "6\0" "7\0" "8\0" "9\0" "10\0";
+  const char *const path = "build/test-seq.txt";
+  char index_path[100];
+  struct stat sb;
+  int i;
+
+  /* NUL-terminated lines from a file, from STDIN and held back. */
+  for(i = 0; i < 2; i++){
+    test_head_main("3",
+                   NULL,
+                   0,
+                   "test/files/nul-3.txt",
+                   EXIT_SUCCESS,
+                   i == 0 ? "-z" : "-d",
+                   i == 0 ? "test/files/nul-10.txt" : "",
+                   i == 0 ? NULL : "test/files/nul-10.txt",
+                   NULL);
+  }
+  test_head_main("3",
+                 nul_10,
+                 sizeof(nul_10) - 1,
+                 "test/files/nul-3.txt",
+                 EXIT_SUCCESS,
+                 "-z",
+                 NULL);
+  test_head_main("-3",
+                 NULL,
+                 0,
+                 "test/files/nul-elide-3.txt",
+                 EXIT_SUCCESS,
+                 "-z",
+                 "test/files/nul-10.txt",
+                 NULL);
+  test_head_main("-3",
+                 nul_10,
+                 sizeof(nul_10) - 1,
+                 "test/files/nul-elide-3.txt",
+                 EXIT_SUCCESS,
+                 "-z",
+                 NULL);
+
+  /* Lines ending with a space. */
+  test_head_main("3",
+                 NULL,
+                 0,
+                 "test/files/d-space-3.txt",
+                 EXIT_SUCCESS,
+                 "-d",
+                 " ",
+                 "test/files/10.txt",
+                 NULL);
+
+  /* The index of other delimiters gets kept apart. */
+  assert(mkdir("build/index", 0755) == 0 || errno == EEXIST);
+  assert(stat(path, &sb) == 0);
+  sprintf(index_path,
+          "build/index/%lx-%lx-30.idx",
+          (unsigned long)sb.st_dev,
+          (unsigned long)sb.st_ino);
+  unlink(index_path);
+  test_head_main("20000", NULL, 0, NULL, EXIT_SUCCESS, "-d0", path, NULL);
+  assert(rename(PATH_TMP_FILE, "build/test-seq-d0.txt") == 0);
+  test_head_main("20000",
+                 NULL,
+                 0,
+                 "build/test-seq-d0.txt",
+                 EXIT_SUCCESS,
+                 "-d0",
+                 "--index-dir=build/index",
+                 path,
+                 NULL);
+  assert(stat(index_path, &sb) == 0);
+
+  /* Delimiter longer than one byte. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "-d",
+                 "ab",
+                 "test/files/10.txt",
+                 NULL);
+}
+
+/**
+ * Create a sparse file.
+ *
+ * @param[in] path File to create.
+ * @param[in] data Bytes at the start of the file.
+ * @param[in] hole Size of the hole after @p data.
+ * @param[in] tail Bytes after the hole.
+ */
+static void
+test_sparse_file(const char *const path,
+                 const char *const data,
+                 const off_t hole,
+                 const char *const tail){
+  FILE *fp;
+
+  fp = fopen(path, "w");
+  assert(fp);
+  assert(fputs(data, fp) >= 0);
+  assert(fseeko(fp, (off_t)strlen(data) + hole, SEEK_SET) == 0);
+  assert(fputs(tail, fp) >= 0);
+  assert(fclose(fp) == 0);
+  assert(truncate(path, (off_t)(strlen(data) + strlen(tail)) + hole) == 0);
+}
+
+/**
+ * Run all test cases for files with holes.
+ */
+static void
+test_all_sparse(void){
+  const off_t hole = 20 * 1024 * 1024;
+  char *seq;
+  size_t len;
+  int i;
+
+  test_sparse_file("build/test-sparse-a.txt", "1\n", hole, "2\n3\n");
+  test_sparse_file("build/test-sparse-a.txt.2", "1\n", hole, "2\n");
+  test_sparse_file("build/test-sparse-b.txt", "", hole, "x\ny\n");
+  test_sparse_file("build/test-sparse-b.txt.1", "", hole, "x\n");
+  test_sparse_file("build/test-sparse-zero.3", "", 3, "");
+  test_sparse_file("build/test-sparse-zero.10", "", 10, "");
+
+  /* Line spanning a hole, copied by the kernel or written as zeros. */
+  for(i = 0; i < 3; i++){
+    g_test_stdout = (i == 0) ? TEST_STDOUT_FILE : TEST_STDOUT_PIPE;
+    g_test_seam_err_ctr_copy_file_range = (i == 2) ? 0 : -1;
+    g_test_seam_copy_errno = EXDEV;
+    test_head_main("2",
+                   NULL,
+                   0,
+                   "build/test-sparse-a.txt.2",
+                   EXIT_SUCCESS,
+                   "build/test-sparse-a.txt",
+                   NULL);
+  }
+  g_test_stdout = TEST_STDOUT_FILE;
+  g_test_seam_copy_errno = EIO;
+  g_test_seam_err_ctr_copy_file_range = -1;
+
+  /* File starting with a hole. */
+  test_head_main("1",
+                 NULL,
+                 0,
+                 "build/test-sparse-b.txt.1",
+                 EXIT_SUCCESS,
+                 "build/test-sparse-b.txt",
+                 NULL);
+
+  /* Each byte of a hole ends a NUL-terminated line. */
+  test_head_main("3",
+                 NULL,
+                 0,
+                 "build/test-sparse-zero.3",
+                 EXIT_SUCCESS,
+                 "-z",
+                 "build/test-sparse-b.txt",
+                 NULL);
+
+  /* Bytes of a hole, written as zeros when the kernel refuses to copy. */
+  g_test_seam_err_ctr_copy_file_range = 0;
+  g_test_seam_copy_errno = EXDEV;
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "build/test-sparse-zero.10",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "10",
+                 "build/test-sparse-b.txt",
+                 NULL);
+  g_test_seam_copy_errno = EIO;
+  g_test_seam_err_ctr_copy_file_range = -1;
+
+  /* Holes unknown, scan the zero bytes. */
+  g_test_seam_err_ctr_lseek = 0;
+  test_head_main("1",
+                 NULL,
+                 0,
+                 "build/test-sparse-b.txt.1",
+                 EXIT_SUCCESS,
+                 "build/test-sparse-b.txt",
+                 NULL);
+  g_test_seam_err_ctr_lseek = -1;
+
+  /* Failed to allocate the zero block or to write a hole. */
+  g_test_stdout = TEST_STDOUT_PIPE;
+  for(i = 0; i < 2; i++){
+    g_test_seam_err_ctr_malloc = (i == 0) ? 0 : -1;
+    g_test_seam_err_ctr_writev = (i == 1) ? 0 : -1;
+    test_head_main("1",
+                   NULL,
+                   0,
+                   NULL,
+                   EXIT_FAILURE,
+                   "build/test-sparse-b.txt",
+                   NULL);
+  }
+  g_test_seam_err_ctr_malloc = -1;
+  g_test_seam_err_ctr_writev = -1;
+  g_test_stdout = TEST_STDOUT_FILE;
+
+  /* Index skips the hole. */
+  seq = malloc(20000 * 8);
+  assert(seq);
+  len = 0;
+  for(i = 1; i <= 20000; i++){
+    len += (size_t)sprintf(seq + len, "%d\n", i);
+  }
+  test_sparse_file("build/test-sparse-seq.txt", seq, hole, "end\n");
+  free(seq);
+  test_head_main("40000",
+                 NULL,
+                 0,
+                 "build/test-sparse-seq.txt",
+                 EXIT_SUCCESS,
+                 "--index-dir=build/index",
+                 "build/test-sparse-seq.txt",
+                 NULL);
+}
+
+/**
+ * Run all test cases for counting the lines of a large file in parallel.
+ *
+ * Lowers the chunk size to 1 MiB, so that the test files split into
+ * several chunks.
+ */
+static void
+test_all_pscan(void){
+  const size_t chunk = g_head_pscan_chunk;
+  int i;
+
+  g_head_pscan_chunk = 1024 * 1024;
+
+  /* Last line in a later chunk, file or pipe output. */
+  for(i = 0; i < 2; i++){
+    g_test_stdout = (i == 0) ? TEST_STDOUT_FILE : TEST_STDOUT_PIPE;
+    test_head_main("500000",
+                   NULL,
+                   0,
+                   "build/test-seq-big.txt.500000",
+                   EXIT_SUCCESS,
+                   "--scan-threads=4",
+                   "build/test-seq-big.txt",
+                   NULL);
+  }
+  g_test_stdout = TEST_STDOUT_FILE;
+
+  /* Last line in the first chunk. */
+  test_head_main("20000",
+                 NULL,
+                 0,
+                 "build/test-seq.txt.20000",
+                 EXIT_SUCCESS,
+                 "--scan-threads=4",
+                 "build/test-seq-big.txt",
+                 NULL);
+
+  /* File ends before the last line wanted. */
+  test_head_main("2000000",
+                 NULL,
+                 0,
+                 "build/test-seq-big.txt",
+                 EXIT_SUCCESS,
+                 "--scan-threads=2",
+                 "build/test-seq-big.txt",
+                 NULL);
+
+  /* No line end at all. */
+  test_head_main("1",
+                 NULL,
+                 0,
+                 "build/test-long-line.txt",
+                 EXIT_SUCCESS,
+                 "--scan-threads=4",
+                 "build/test-long-line.txt",
+                 NULL);
+
+  /*
+   * Failed to map the first chunk, to start the workers, or to map a
+   * chunk in a worker: scan the file in a single thread.
+   */
+  for(i = 0; i < 3; i++){
+    g_test_seam_err_ctr_mmap = (i == 0) ? 0 : (i == 2) ? 1 : -1;
+    g_test_seam_err_ctr_pthread_create = (i == 1) ? 0 : -1;
+    test_head_main("500000",
+                   NULL,
+                   0,
+                   "build/test-seq-big.txt.500000",
+                   EXIT_SUCCESS,
+                   "--scan-threads=1024",
+                   "build/test-seq-big.txt",
+                   NULL);
+  }
+  g_test_seam_err_ctr_mmap = -1;
+  g_test_seam_err_ctr_pthread_create = -1;
+
+  /* Failed to write the counted lines. */
+  g_test_stdout = TEST_STDOUT_PIPE;
+  g_test_seam_err_ctr_splice = 0;
+  test_head_main("500000",
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "--scan-threads=4",
+                 "build/test-seq-big.txt",
+                 NULL);
+  g_test_seam_err_ctr_splice = -1;
+  g_test_stdout = TEST_STDOUT_FILE;
+
+  /* Invalid number of threads. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "--scan-threads=0",
+                 "test/files/10.txt",
+                 NULL);
+
+  /* File too small to split at the default chunk size. */
+  g_head_pscan_chunk = chunk;
+  test_head_main("500000",
+                 NULL,
+                 0,
+                 "build/test-seq-big.txt.500000",
+                 EXIT_SUCCESS,
+                 "--scan-threads=4",
+                 "build/test-seq-big.txt",
+                 NULL);
+}
+
+/**
+ * Run all test cases for reading the file list from a file.
+ */
+static void
+test_all_files_from(void){
+  const char *const list = "test/files/5.txt\ntest/files/1.txt\n";
+  const char *const path = "test/files/0.txt";
+  char *buf;
+  size_t len;
+  size_t reflen;
+  int i;
+
+  /* Newline or NUL separated, with or without the last separator. */
+  test_write_file("build/test-list.txt", list, strlen(list));
+  test_write_file("build/test-list0.txt",
+                  "test/files/5.txt\0test/files/1.txt",
+                  33);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-5-1.txt",
+                 EXIT_SUCCESS,
+                 "--files-from=build/test-list.txt",
+                 NULL);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-5-1.txt",
+                 EXIT_SUCCESS,
+                 "--files0-from=build/test-list0.txt",
+                 NULL);
+
+  /* List read from STDIN. */
+  test_head_main(NULL,
+                 list,
+                 strlen(list),
+                 "test/files/comb-5-1.txt",
+                 EXIT_SUCCESS,
+                 "--files-from=-",
+                 NULL);
+
+  /* A single path gets no banner. */
+  test_write_file("build/test-list.txt", "test/files/10.txt", 17);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/10.txt",
+                 EXIT_SUCCESS,
+                 "--files-from=build/test-list.txt",
+                 NULL);
+
+  /* List longer than a batch, printed serially and by the worker pool. */
+  buf = malloc(1000 * 64);
+  assert(buf);
+  len = 0;
+  reflen = 0;
+  for(i = 0; i < 1000; i++){
+    len += (size_t)sprintf(buf + len, "%s\n", path);
+  }
+  test_write_file("build/test-list.txt", buf, len);
+  for(i = 0; i < 1000; i++){
+    reflen += (size_t)sprintf(buf + reflen,
+                              "%s==> %s <==\n",
+                              (i == 0) ? "" : "\n",
+                              path);
+  }
+  test_write_file("build/test-list.ref", buf, reflen);
+  free(buf);
+  for(i = 0; i < 2; i++){
+    test_head_main(NULL,
+                   NULL,
+                   0,
+                   "build/test-list.ref",
+                   EXIT_SUCCESS,
+                   "-j",
+                   (i == 0) ? "1" : "2",
+                   "--files-from=build/test-list.txt",
+                   NULL);
+  }
+
+  /* Zero-length path skipped. */
+  test_write_file("build/test-list.txt", "\ntest/files/10.txt\n", 19);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/10.txt",
+                 EXIT_FAILURE,
+                 "--files-from=build/test-list.txt",
+                 NULL);
+
+  /* List missing, unreadable, or combined with file operands. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "--files-from=build/test-list-missing.txt",
+                 NULL);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "--files-from=test/files",
+                 NULL);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "--files-from=build/test-list.txt",
+                 "test/files/10.txt",
+                 NULL);
+}
+
+/**
+ * Print a file given as eight file operands, and compare the output with
+ * the worker pool printing the same operands.
+ *
+ * @param[in] opt   Option selecting lines or bytes.
+ * @param[in] count Number of lines or bytes.
+ * @param[in] path  File operand.
+ */
+static void
+test_head_many(const char *const opt,
+               const char *const count,
+               const char *const path){
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_SUCCESS,
+                 "-j", "2", opt, count,
+                 path, path, path, path, path, path, path, path,
+                 NULL);
+  assert(rename(PATH_TMP_FILE, PATH_REF_FILE) == 0);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 PATH_REF_FILE,
+                 EXIT_SUCCESS,
+                 opt, count,
+                 path, path, path, path, path, path, path, path,
+                 NULL);
+  assert(unlink(PATH_REF_FILE) == 0);
+}
+
+/**
+ * Run all test cases for reading ahead the upcoming file operands.
+ */
+static void
+test_all_prefetch(void){
+  const char *const paths[] = {
+    "test/files/5.txt",
+    "build/test-seq.txt",
+    "test/files/0.txt",
+    "/noexist.txt",
+    "test"
+  };
+  const char *const wide = "build/test-wide.txt";
+  char ref[4096];
+  char *buf;
+  size_t len;
+  size_t i;
+
+  /* More files than kept open, read ahead once the line length is known. */
+  len = 0;
+  for(i = 0; i < 15; i++){
+    len += (size_t)sprintf(ref + len,
+                           "%s==> %s <==\n%s",
+                           (i == 0) ? "" : "\n",
+                           paths[i % 3],
+                           (i % 3 == 0) ? "1: line 1\n2: line 2\n"
+                                        : (i % 3 == 1) ? "1\n2\n" : "");
+  }
+  test_write_file("build/test-prefetch.ref", ref, len);
+  test_head_main("2",
+                 NULL,
+                 0,
+                 "build/test-prefetch.ref",
+                 EXIT_SUCCESS,
+                 paths[0], paths[1], paths[2], paths[0], paths[1],
+                 paths[2], paths[0], paths[1], paths[2], paths[0],
+                 paths[1], paths[2], paths[0], paths[1], paths[2],
+                 NULL);
+
+  /* Many file operands with heads expected to outgrow the io_uring
+   * window get read ahead serially. */
+  test_head_many("-n", "600", paths[1]);
+
+  /* Lines longer than expected outgrow the io_uring window. */
+  len = 3 * 33000;
+  buf = malloc(len);
+  assert(buf);
+  memset(buf, 'a', len);
+  for(i = 32999; i < len; i += 33000){
+    buf[i] = '\n';
+  }
+  test_write_file(wide, buf, len);
+  free(buf);
+  test_head_many("-n", "2", wide);
+  test_head_many("-c", "100", wide);
+  assert(unlink(wide) == 0);
+
+  /* Missing files and directories get reported once due. */
+  test_head_main("1",
+                 NULL,
+                 0,
+                 "test/files/comb-noexist-1.txt",
+                 EXIT_FAILURE,
+                 paths[3],
+                 "test/files/1.txt",
+                 NULL);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "-c",
+                 "1",
+                 paths[4],
+                 paths[0],
+                 NULL);
+}
+
+/**
+ * Log file printed by @ref test_resume.
+ */
+#define PATH_RESUME_LOG "build/test-resume.log"
+
+/**
+ * State file used by @ref test_resume.
+ */
+#define PATH_RESUME_STATE "build/test-resume.state"
+
+/**
+ * Print the new lines of @ref PATH_RESUME_LOG with (--resume).
+ *
+ * @param[in] nlines      Number of lines to print.
+ * @param[in] expect      Expected output.
+ * @param[in] exit_status Expected exit status code.
+ */
+static void
+test_resume(const char *const nlines,
+            const char *const expect,
+            const int exit_status){
+  test_write_file("build/test-resume.ref", expect, strlen(expect));
+  test_head_main(nlines,
+                 NULL,
+                 0,
+                 "build/test-resume.ref",
+                 exit_status,
+                 "--resume=" PATH_RESUME_STATE,
+                 PATH_RESUME_LOG,
+                 NULL);
+}
+
+/**
+ * Append bytes to @ref PATH_RESUME_LOG.
+ *
+ * @param[in] s Bytes to append.
+ */
+static void
+test_resume_append(const char *const s){
+  int fd;
+
+  fd = open(PATH_RESUME_LOG, O_WRONLY | O_APPEND);
+  assert(fd >= 0);
+  assert(write(fd, s, strlen(s)) == (ssize_t)strlen(s));
+  assert(close(fd) == 0);
+}
+
+/**
+ * Run all test cases for resuming from the previous run with (--resume).
+ */
+static void
+test_all_resume(void){
+  const char *const state = "--resume=" PATH_RESUME_STATE;
+  const char *const rotated = "==> " PATH_RESUME_LOG " <==\na\nb\n\n"
+                              "==> " PATH_RESUME_LOG ".1 <==\n8\n";
+
+  errno = 0;
+  assert(unlink(PATH_RESUME_STATE) == 0 || errno == ENOENT);
+  test_write_file(PATH_RESUME_LOG, "1\n2\n3\n4\n5\n", 10);
+
+  /* Next lines on each run, until none are left. */
+  test_resume("3", "1\n2\n3\n", EXIT_SUCCESS);
+  test_resume("3", "4\n5\n", EXIT_SUCCESS);
+  test_resume("3", "", EXIT_SUCCESS);
+
+  /* A line without its delimiter yet waits for the next run. */
+  test_resume_append("6\n7");
+  test_resume("3", "6\n", EXIT_SUCCESS);
+  test_resume_append("\n8\n");
+  test_resume("1", "7\n", EXIT_SUCCESS);
+
+  /* Rotated file continues under its new name, new file from the start. */
+  assert(rename(PATH_RESUME_LOG, PATH_RESUME_LOG ".1") == 0);
+  test_write_file(PATH_RESUME_LOG, "a\nb\n", 4);
+  test_write_file("build/test-resume.ref", rotated, strlen(rotated));
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "build/test-resume.ref",
+                 EXIT_SUCCESS,
+                 state,
+                 PATH_RESUME_LOG,
+                 PATH_RESUME_LOG ".1",
+                 NULL);
+
+  /* Truncated file starts over. */
+  test_write_file(PATH_RESUME_LOG, "c\n", 2);
+  test_resume(NULL, "c\n", EXIT_SUCCESS);
+
+  /* Input without a checkpoint. */
+  test_head_main("1",
+                 "1: line 1\n2: line 2\n",
+                 20,
+                 "test/files/1.txt",
+                 EXIT_SUCCESS,
+                 state,
+                 NULL);
+
+  /* Failed to map the file, which keeps the checkpoint. */
+  test_resume_append("d\n");
+  g_test_seam_err_ctr_mmap = 0;
+  test_resume(NULL, "", EXIT_FAILURE);
+  g_test_seam_err_ctr_mmap = -1;
+  test_resume(NULL, "d\n", EXIT_SUCCESS);
+
+  /* File name that would end its checkpoint early. */
+  test_write_file("build/test-resume\nlog", "x\n", 2);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 state,
+                 "build/test-resume\nlog",
+                 NULL);
+
+  /* Byte counts, or all but the last lines. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 state,
+                 "-c",
+                 "1",
+                 PATH_RESUME_LOG,
+                 NULL);
+  test_head_main("-1",
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 state,
+                 PATH_RESUME_LOG,
+                 NULL);
+
+  /* Invalid, unreadable or unwritable state file. */
+  test_write_file(PATH_RESUME_STATE, "head-resume 1\n1 2 3\n", 20);
+  test_resume(NULL, "", EXIT_FAILURE);
+  test_write_file(PATH_RESUME_STATE, "head-resume 1\n1 2 3 4 \n", 24);
+  test_resume(NULL, "", EXIT_FAILURE);
+  test_write_file(PATH_RESUME_STATE, "head-resume 2\n", 14);
+  test_resume(NULL, "", EXIT_FAILURE);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "--resume=build",
+                 PATH_RESUME_LOG,
+                 NULL);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "build/test-resume.log",
+                 EXIT_FAILURE,
+                 "--resume=build/missing/state",
+                 PATH_RESUME_LOG,
+                 NULL);
+}
+
+/**
+ * Start (--serve) in a child process and wait for its socket.
+ *
+ * @param[in] jobs Number of server threads passed to (-j).
+ * @return         Process ID of the server.
+ */
+static pid_t
+test_serve_start(const char *const jobs){
+  const struct timespec delay = {0, 10 * 1000 * 1000};
+  struct stat sb;
+  pid_t pid;
+  int i;
+
+  errno = 0;
+  assert(unlink(PATH_SERVE_SOCK) == 0 || errno == ENOENT);
+  g_argc = 1;
+  strcpy(g_argv[g_argc++], "--serve=" PATH_SERVE_SOCK);
+  strcpy(g_argv[g_argc++], "-j");
+  strcpy(g_argv[g_argc++], jobs);
+  pid = fork();
+  assert(pid >= 0);
+  if(pid == 0){
+    exit(head_main(g_argc, g_argv));
+  }
+  for(i = 0; i < 500 && stat(PATH_SERVE_SOCK, &sb) != 0; i++){
+    nanosleep(&delay, NULL);
+  }
+  assert(S_ISSOCK(sb.st_mode));
+  assert((sb.st_mode & 0777) == 0600);
+  return pid;
+}
+
+/**
+ * Stop the server started by @ref test_serve_start.
+ *
+ * @param[in] pid Process ID of the server.
+ */
+static void
+test_serve_stop(const pid_t pid){
+  struct stat sb;
+  int status;
+
+  assert(kill(pid, SIGTERM) == 0);
+  assert(waitpid(pid, &status, 0) == pid);
+  assert(WIFEXITED(status));
+  assert(WEXITSTATUS(status) == EXIT_SUCCESS);
+  assert(stat(PATH_SERVE_SOCK, &sb) != 0);
+}
+
+/**
+ * Send a raw request to the server started by @ref test_serve_start.
+ *
+ * @param[in] msg  Request bytes.
+ * @param[in] len  Number of bytes in @p msg.
+ * @param[in] nfds Number of file descriptors passed with the request,
+ *                 all refering to /dev/null except for the last one,
+ *                 which is the working directory.
+ * @return         Exit status sent back by the server.
+ */
+static int
+test_serve_raw(const char *const msg,
+               const size_t len,
+               const size_t nfds){
+  union{
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(int) * 4)];
+  } ctl;
+  struct sockaddr_un addr;
+  struct msghdr mh;
+  struct cmsghdr *cm;
+  struct iovec iov;
+  int fds[4];
+  int status;
+  int sock;
+  size_t i;
+
+  for(i = 0; i < nfds; i++){
+    fds[i] = open((i + 1 < nfds) ? "/dev/null" : ".", O_RDONLY);
+    assert(fds[i] >= 0);
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, PATH_SERVE_SOCK);
+  iov.iov_base = (void *)(uintptr_t)msg;
+  iov.iov_len = len;
+  memset(&mh, 0, sizeof(mh));
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  if(nfds > 0){
+    mh.msg_control = ctl.buf;
+    mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+    cm = CMSG_FIRSTHDR(&mh);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+    memcpy(CMSG_DATA(cm), fds, sizeof(int) * nfds);
+  }
+  sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  assert(sock >= 0);
+  assert(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+  assert(sendmsg(sock, &mh, 0) == (ssize_t)len);
+  assert(recv(sock, &status, sizeof(status), 0) == sizeof(status));
+  assert(close(sock) == 0);
+  for(i = 0; i < nfds; i++){
+    assert(close(fds[i]) == 0);
+  }
+  return status;
+}
+
+/**
+ * Connect to the server started by @ref test_serve_start as another user.
+ *
+ * Only works when running as root, which may switch to any user. The
+ * socket gets reached from within the build directory, whose parent
+ * directories may not be searchable by the other user.
+ *
+ * @retval true  The server closed the connection without a reply.
+ * @retval false Got a reply, or could not switch users.
+ */
+static bool
+test_serve_other_user(void){
+  struct sockaddr_un addr;
+  int status;
+  int sock;
+  pid_t pid;
+
+  assert(chmod(PATH_SERVE_SOCK, 0666) == 0);
+  pid = fork();
+  assert(pid >= 0);
+  if(pid == 0){
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, strrchr(PATH_SERVE_SOCK, '/') + 1);
+    sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if(sock < 0 ||
+       chdir("build") != 0 ||
+       setuid(65534) != 0 ||
+       connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+      _exit(EXIT_FAILURE);
+    }
+    send(sock, "-n", 3, MSG_NOSIGNAL);
+    if(recv(sock, &status, sizeof(status), 0) > 0){
+      _exit(EXIT_FAILURE);
+    }
+    _exit(EXIT_SUCCESS);
+  }
+  assert(waitpid(pid, &status, 0) == pid);
+  assert(chmod(PATH_SERVE_SOCK, 0600) == 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+/**
+ * Run all test cases for serving requests over a Unix domain socket.
+ */
+static void
+test_all_serve(void){
+  const char *const client = "--client=" PATH_SERVE_SOCK;
+  char path[160];
+  char *ref;
+  size_t len;
+  pid_t pid;
+  int i;
+
+  pid = test_serve_start("2");
+
+  /* Output to each STDOUT type of the client. */
+  for(i = 0; i < 3; i++){
+    g_test_stdout = (enum test_stdout)i;
+    test_head_main(NULL,
+                   NULL,
+                   0,
+                   "test/files/10.txt",
+                   EXIT_SUCCESS,
+                   client,
+                   "test/files/10.txt",
+                   NULL);
+  }
+  g_test_stdout = TEST_STDOUT_FILE;
+
+  /* Banners, and STDIN of the client. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-5-1.txt",
+                 EXIT_SUCCESS,
+                 client,
+                 "test/files/5.txt",
+                 "test/files/1.txt",
+                 NULL);
+  test_head_main("1",
+                 "1: line 1\n2: line 2\n",
+                 20,
+                 "test/files/1.txt",
+                 EXIT_SUCCESS,
+                 client,
+                 NULL);
+
+  /* Index built in memory, then reused along with the open file. */
+  for(i = 0; i < 3; i++){
+    test_head_main("50000",
+                   NULL,
+                   0,
+                   "build/test-seq.txt.50000",
+                   EXIT_SUCCESS,
+                   client,
+                   "build/test-seq.txt",
+                   NULL);
+  }
+  test_head_main("40000",
+                 NULL,
+                 0,
+                 "build/test-seq.txt",
+                 EXIT_SUCCESS,
+                 client,
+                 "-z",
+                 "build/test-seq.txt",
+                 NULL);
+
+  /* More files than cache entries, serially and by the worker pool. */
+  ref = malloc(100 * 64);
+  assert(ref);
+  len = 0;
+  for(i = 0; i < 100; i++){
+    sprintf(path, "build/test-serve-%d.txt", i);
+    test_write_file(path, "x\n", 2);
+    len += (size_t)sprintf(ref + len, "%s\n", path);
+  }
+  test_write_file("build/test-list.txt", ref, len);
+  len = 0;
+  for(i = 0; i < 100; i++){
+    len += (size_t)sprintf(ref + len,
+                           "%s==> build/test-serve-%d.txt <==\nx\n",
+                           (i == 0) ? "" : "\n",
+                           i);
+  }
+  test_write_file("build/test-list.ref", ref, len);
+  free(ref);
+  for(i = 0; i < 2; i++){
+    test_head_main(NULL,
+                   NULL,
+                   0,
+                   "build/test-list.ref",
+                   EXIT_SUCCESS,
+                   client,
+                   "-j",
+                   (i == 0) ? "1" : "2",
+                   "--files-from=build/test-list.txt",
+                   NULL);
+  }
+
+  /* Failed requests. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 client,
+                 "test/files/missing.txt",
+                 NULL);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 client,
+                 "--serve=build/test-nested.sock",
+                 NULL);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 client,
+                 "--stats=5",
+                 "test/files/1.txt",
+                 NULL);
+
+  /* The (--client) argument does not get sent, in any of its forms. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/10.txt",
+                 EXIT_SUCCESS,
+                 "test/files/10.txt",
+                 "--client",
+                 PATH_SERVE_SOCK,
+                 NULL);
+  test_head_main("1",
+                 NULL,
+                 0,
+                 "test/files/1.txt",
+                 EXIT_SUCCESS,
+                 "--cli=" PATH_SERVE_SOCK,
+                 "test/files/1.txt",
+                 NULL);
+
+  /* Invalid option, missing file descriptors, or no final NUL byte. */
+  assert(test_serve_raw("--client=x", 11, 4) == EXIT_FAILURE);
+  assert(test_serve_raw("-x", 3, 4) == EXIT_FAILURE);
+  assert(test_serve_raw("-n", 3, 0) == EXIT_FAILURE);
+  assert(test_serve_raw("-n", 2, 4) == EXIT_FAILURE);
+
+  /* Connection from another user. */
+  if(getuid() == 0){
+    assert(test_serve_other_user());
+  }
+
+  test_serve_stop(pid);
+
+  /* Index loaded from the index directory into the cache. */
+  test_head_main("50000",
+                 NULL,
+                 0,
+                 "build/test-seq.txt.50000",
+                 EXIT_SUCCESS,
+                 "--index-dir=build/index",
+                 "build/test-seq.txt",
+                 NULL);
+  pid = test_serve_start("1");
+  for(i = 0; i < 2; i++){
+    test_head_main("50000",
+                   NULL,
+                   0,
+                   "build/test-seq.txt.50000",
+                   EXIT_SUCCESS,
+                   client,
+                   "--index-dir=build/index",
+                   "build/test-seq.txt",
+                   NULL);
+  }
+  test_serve_stop(pid);
+
+  /* Server not running, or socket path too long. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 client,
+                 "test/files/1.txt",
+                 NULL);
+  for(i = 0; i < 2; i++){
+    sprintf(path, "--%s=build/%0120d.sock", i ? "serve" : "client", 0);
+    test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, path, NULL);
+  }
+
+  /* Failed to bind the socket or to start any thread. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "--serve=build/missing/test.sock",
+                 NULL);
+  g_test_seam_err_ctr_pthread_create = 0;
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "--serve=" PATH_SERVE_SOCK,
+                 NULL);
+  g_test_seam_err_ctr_pthread_create = -1;
+}
+
+/**
+ * Test different failure scenarios.
+ */
+static void
+test_all_errors(void){
+  int i;
+
+  /* Invalid argument. */
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "-x", NULL);
+
+  /* Blank nlines. */
+  test_head_main("", NULL, 0, NULL, EXIT_FAILURE, NULL);
+
+  /* Invalid nbytes character. */
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "-c", "1k", NULL);
+
+  /* Invalid nlines character. */
+  test_head_main("9f", NULL, 0, NULL, EXIT_FAILURE, NULL);
+
+  /* nlines too large (assume unsigned 64 bit). */
+  test_head_main("18446744073709551616", NULL, 0, NULL, EXIT_FAILURE, NULL);
+
+  /* File does not exist. */
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "/noexist.txt", NULL);
+
+  /* Failed to allocate block buffer. */
+  g_test_seam_err_ctr_malloc = 0;
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "/dev/zero", NULL);
+  g_test_seam_err_ctr_malloc = -1;
+
+  /* Failed to get file status. */
+  g_test_seam_err_ctr_fstat = 1;
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "README.md", NULL);
+  g_test_seam_err_ctr_fstat = -1;
+
+  /* Failed to map file and to seek before falling back to read(). */
+  g_test_seam_err_ctr_mmap = 0;
+  g_test_seam_err_ctr_lseek = 0;
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "README.md", NULL);
+  g_test_seam_err_ctr_mmap = -1;
+  g_test_seam_err_ctr_lseek = -1;
+
+  /* Failed to copy file range. */
+  g_test_seam_err_ctr_copy_file_range = 0;
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "README.md", NULL);
+  g_test_seam_err_ctr_copy_file_range = -1;
+
+  /* Failed to unmap file. */
+  g_test_seam_err_ctr_munmap = 0;
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "README.md", NULL);
+  g_test_seam_err_ctr_munmap = -1;
+
+  /* Failed to read file backwards. */
+  g_test_seam_err_ctr_pread = 0;
+  test_head_main("-1", NULL, 0, NULL, EXIT_FAILURE, "README.md", NULL);
+  g_test_seam_err_ctr_pread = -1;
+
+  /* Failed to allocate block buffer for reading backwards. */
+  g_test_seam_err_ctr_malloc = 0;
+  test_head_main("-1", NULL, 0, NULL, EXIT_FAILURE, "README.md", NULL);
+  g_test_seam_err_ctr_malloc = -1;
+
+  /* Invalid negative nlines. */
+  test_head_main("--1", NULL, 0, NULL, EXIT_FAILURE, NULL);
+  test_head_main("-+1", NULL, 0, NULL, EXIT_FAILURE, NULL);
+  test_head_main("+-1", NULL, 0, NULL, EXIT_FAILURE, NULL);
+  test_head_main("+", NULL, 0, NULL, EXIT_FAILURE, NULL);
+
+  /* Count with a leading plus sign. */
+  test_head_main("+5",
+                 NULL,
+                 0,
+                 "test/files/5.txt",
+                 EXIT_SUCCESS,
+                 "test/files/10.txt",
+                 NULL);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/c-12.txt",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "+12",
+                 "test/files/10.txt",
+                 NULL);
+
+  /* Failed to read file. */
+  g_test_seam_err_ctr_read = 0;
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "/dev/zero", NULL);
+  g_test_seam_err_ctr_read = -1;
+
+  /* Failed to write file. */
+  g_test_seam_err_ctr_writev = 0;
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "/dev/zero", NULL);
+  g_test_seam_err_ctr_writev = -1;
+
+  /* Failed to close file. */
+  g_test_seam_err_ctr_close = 0;
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "README.md", NULL);
+  g_test_seam_err_ctr_close = -1;
+
+  /* Failed to write banner together with the first bytes of a file. */
+  g_test_seam_err_ctr_writev = 0;
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "README.md",
+                 "README.md",
+                 NULL);
+  g_test_seam_err_ctr_writev = -1;
+
+  /* Failed to write banner of an empty file. */
+  g_test_seam_err_ctr_writev = 0;
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "test/files/0.txt",
+                 "test/files/0.txt",
+                 NULL);
+  g_test_seam_err_ctr_writev = -1;
+
+  /* Failed to write banner in front of a large file copied by the kernel. */
+  g_test_seam_err_ctr_writev = 0;
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "-c",
+                 "100000",
+                 "build/test-long-line.txt",
+                 "build/test-long-line.txt",
+                 NULL);
+  g_test_seam_err_ctr_writev = -1;
+
+#ifdef HEAD_ZLIB
+  /* Truncated gzip file. */
+  test_head_main("100000",
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "--decompress",
+                 "test/files/10-repeat-truncated.txt.gz",
+                 NULL);
+
+  /* Corrupted gzip file. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "--decompress",
+                 "test/files/corrupt.txt.gz",
+                 NULL);
+
+  /* Failed to allocate decompression buffers. */
+  for(i = 0; i < 2; i++){
+    g_test_seam_err_ctr_malloc = i;
+    test_head_main(NULL,
+                   NULL,
+                   0,
+                   NULL,
+                   EXIT_FAILURE,
+                   "--decompress",
+                   "test/files/10.txt.gz",
+                   NULL);
+  }
+  g_test_seam_err_ctr_malloc = -1;
+
+  /* Failed to read gzip file. */
+  g_test_seam_err_ctr_read = 0;
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "--decompress",
+                 "test/files/10.txt.gz",
+                 NULL);
+  g_test_seam_err_ctr_read = -1;
+#endif /* HEAD_ZLIB */
+
+  /* First file does not exist. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-noexist-1.txt",
+                 EXIT_FAILURE,
+                 "/noexist.txt",
+                 "test/files/1.txt",
+                 NULL);
+
+  /* File does not exist while printing files in parallel. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-noexist-1.txt",
+                 EXIT_FAILURE,
+                 "-j",
+                 "2",
+                 "/noexist.txt",
+                 "test/files/1.txt",
+                 NULL);
+
+  /* Failed to open and read files through io_uring. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-uring-errors.txt",
+                 EXIT_FAILURE,
+                 "test/files/1.txt",
+                 "/noexist.txt",
+                 "test/files",
+                 "test/files/5.txt",
+                 "test/files/1.txt",
+                 "test/files/1.txt",
+                 "test/files/1.txt",
+                 "test/files/1.txt",
+                 NULL);
+
+  /* Finish printing serially after io_uring fails, before and after
+   * submitting reads. */
+  for(i = 1; i < 3; i++){
+    g_test_seam_err_ctr_syscall = i;
+    test_head_main("5",
+                   NULL,
+                   0,
+                   "test/files/comb-j-8.txt",
+                   EXIT_SUCCESS,
+                   "test/files/1.txt",
+                   "test/files/10.txt",
+                   "test/files/5-no-eol.txt",
+                   "test/files/0.txt",
+                   "test/files/10.txt",
+                   "test/files/1.txt",
+                   "test/files/5.txt",
+                   "test/files/10.txt",
+                   NULL);
+  }
+  g_test_seam_err_ctr_syscall = -1;
+
+  /* Failed to collect output of a file printed in parallel. */
+  g_test_seam_err_ctr_realloc = 0;
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "-j",
+                 "2",
+                 "test/files/1.txt",
+                 "test/files/1.txt",
+                 NULL);
+  g_test_seam_err_ctr_realloc = -1;
+
+  /* Failed to allocate the worker pool. */
+  g_test_seam_err_ctr_malloc = 0;
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-5-1.txt",
+                 EXIT_SUCCESS,
+                 "-j",
+                 "2",
+                 "test/files/5.txt",
+                 "test/files/1.txt",
+                 NULL);
+  g_test_seam_err_ctr_malloc = -1;
+
+  /* Invalid number of jobs. */
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "-j", "0", NULL);
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "-j", "1025", NULL);
+  test_head_main(NULL, NULL, 0, NULL, EXIT_FAILURE, "-j", "x", NULL);
+
+  /* Second file does not exist. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-1-noexist.txt",
+                 EXIT_FAILURE,
+                 "test/files/1.txt",
+                 "/noexist.txt",
+                 NULL);
+}
+
+/**
+ * Run test cases where we send data through STDIN.
+ */
+static void
+test_all_stdin(void){
+  const char *const stdin_bytes =
+  "1: line 1\n"
+  "2: line 2\n"
+  "3: line 3\n"
+  "4: line 4\n"
+  "5: line 5\n";
+  size_t stdin_bytes_len;
+  int i;
+
+  stdin_bytes_len = strlen(stdin_bytes);
+
+  /* Use STDIN. */
+  test_head_main(NULL,
+                 stdin_bytes,
+                 stdin_bytes_len,
+                 "test/files/5.txt",
+                 EXIT_SUCCESS,
+                 NULL);
+
+  /* Print bytes from STDIN. */
+  test_head_main(NULL,
+                 stdin_bytes,
+                 stdin_bytes_len,
+                 "test/files/c-12.txt",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "12",
+                 NULL);
+
+  /* Print all but the last lines or bytes from STDIN. */
+  test_head_main("-2",
+                 stdin_bytes,
+                 stdin_bytes_len,
+                 "test/files/3.txt",
+                 EXIT_SUCCESS,
+                 NULL);
+  test_head_main("-2",
+                 stdin_bytes,
+                 stdin_bytes_len - 1,
+                 "test/files/3.txt",
+                 EXIT_SUCCESS,
+                 NULL);
+  test_head_main("-9",
+                 stdin_bytes,
+                 stdin_bytes_len,
+                 "test/files/0.txt",
+                 EXIT_SUCCESS,
+                 NULL);
+  test_head_main(NULL,
+                 stdin_bytes,
+                 stdin_bytes_len,
+                 "test/files/c-12.txt",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "-38",
+                 NULL);
+
+  /* Fail to grow the buffer or ring for STDIN. */
+  for(i = 0; i < 2; i++){
+    g_test_seam_err_ctr_realloc = i;
+    test_head_main("-2",
+                   stdin_bytes,
+                   stdin_bytes_len,
+                   NULL,
+                   EXIT_FAILURE,
+                   NULL);
+    g_test_seam_err_ctr_realloc = -1;
+  }
+
+  /* Fail to read from STDIN while holding back lines. */
+  g_test_seam_err_ctr_read = 0;
+  test_head_main("-2",
+                 stdin_bytes,
+                 stdin_bytes_len,
+                 NULL,
+                 EXIT_FAILURE,
+                 NULL);
+  g_test_seam_err_ctr_read = -1;
+
+  /* Fail to write while holding back lines. */
+  g_test_seam_err_ctr_writev = 0;
+  test_head_main("-2",
+                 stdin_bytes,
+                 stdin_bytes_len,
+                 NULL,
+                 EXIT_FAILURE,
+                 NULL);
+  g_test_seam_err_ctr_writev = -1;
+
+  /* Fail to read from STDIN. */
+  g_test_seam_err_ctr_read = 0;
+  test_head_main(NULL,
+                 stdin_bytes,
+                 stdin_bytes_len,
+                 NULL,
+                 EXIT_FAILURE,
+                 NULL);
+  g_test_seam_err_ctr_read = -1;
+
+}
+
+/**
+ * Run all test cases for the head utility.
+ */
+static void
+test_all(void){
+  const enum test_stdout stdout_list[] = {
+    TEST_STDOUT_FILE,
+    TEST_STDOUT_PIPE,
+    TEST_STDOUT_SOCKET
+  };
+  char raw[12];
+  FILE *fp;
+  int i;
+
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/10.txt",
+                 EXIT_SUCCESS,
+                 "test/files/10.txt",
+                 NULL);
+
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-5-1.txt",
+                 EXIT_SUCCESS,
+                 "test/files/5.txt",
+                 "test/files/1.txt",
+                 NULL);
+
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-1-10-1.txt",
+                 EXIT_SUCCESS,
+                 "test/files/1.txt",
+                 "test/files/10.txt",
+                 "test/files/1.txt",
+                 NULL);
+
+  /* Print out 5 out of 10 lines in the input file. */
+  test_head_main("5",
+                 NULL,
+                 0,
+                 "test/files/5.txt",
+                 EXIT_SUCCESS,
+                 "test/files/10.txt",
+                 NULL);
+
+  /* Print 0 lines from the input file. */
+  test_head_main("0",
+                 NULL,
+                 0,
+                 "test/files/0.txt",
+                 EXIT_SUCCESS,
+                 "test/files/10.txt",
+                 NULL);
+
+  /* Print only 10 lines with higer nlimit. */
+  test_head_main("100",
+                 NULL,
+                 0,
+                 "test/files/10.txt",
+                 EXIT_SUCCESS,
+                 "test/files/10.txt",
+                 NULL);
+
+  /* Combine two 5-line outputs from 10 line file. */
+  test_head_main("5",
+                 NULL,
+                 0,
+                 "test/files/comb-10-10_5.txt",
+                 EXIT_SUCCESS,
+                 "test/files/10.txt",
+                 "test/files/10.txt",
+                 NULL);
+
+  /* 98 lines from random file. */
+  test_head_main("98",
+                 NULL,
+                 0,
+                 "build/test-rand.txt.98",
+                 EXIT_SUCCESS,
+                 "build/test-rand.txt",
+                 NULL);
+
+  /* Maximum allowed nlines value (assume unsigned 64 bit). */
+  test_head_main("18446744073709551615",
+                 NULL,
+                 0,
+                 "build/test-rand.txt",
+                 EXIT_SUCCESS,
+                 "build/test-rand.txt",
+                 NULL);
+
+  /* File without ending newline. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/5-no-eol.txt",
+                 EXIT_SUCCESS,
+                 "test/files/5-no-eol.txt",
+                 NULL);
+
+  /* Fall back to read() when the file cannot get mapped. */
+  g_test_seam_err_ctr_mmap = 0;
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/10.txt",
+                 EXIT_SUCCESS,
+                 "test/files/10.txt",
+                 NULL);
+  g_test_seam_err_ctr_mmap = -1;
+
+  /* Write from the mapping when the kernel refuses to copy. */
+  for(i = 0; i < 4; i++){
+    g_test_seam_err_ctr_copy_file_range = 0;
+    g_test_seam_err_ctr_splice = 0;
+    g_test_seam_err_ctr_sendfile = 0;
+    g_test_stdout = stdout_list[i % 3];
+    g_test_seam_copy_errno = (i < 3) ? EINVAL : EXDEV;
+    test_head_main(NULL,
+                   NULL,
+                   0,
+                   "test/files/10.txt",
+                   EXIT_SUCCESS,
+                   "test/files/10.txt",
+                   NULL);
+  }
+  g_test_seam_copy_errno = EIO;
+  g_test_seam_err_ctr_copy_file_range = -1;
+  g_test_seam_err_ctr_splice = -1;
+  g_test_seam_err_ctr_sendfile = -1;
+
+  /* Copy to a pipe and a socket. */
+  for(i = 1; i < 3; i++){
+    g_test_stdout = stdout_list[i];
+    test_head_main("5",
+                   NULL,
+                   0,
+                   "test/files/comb-10-10_5.txt",
+                   EXIT_SUCCESS,
+                   "test/files/10.txt",
+                   "test/files/10.txt",
+                   NULL);
+  }
+  g_test_stdout = TEST_STDOUT_FILE;
+
+  /* Fall back to printing the mapping when copying the whole file fails. */
+  g_test_seam_err_ctr_copy_file_range = 0;
+  g_test_seam_copy_errno = EXDEV;
+  test_head_main("100",
+                 NULL,
+                 0,
+                 "test/files/10.txt",
+                 EXIT_SUCCESS,
+                 "test/files/10.txt",
+                 NULL);
+  g_test_seam_copy_errno = EIO;
+  g_test_seam_err_ctr_copy_file_range = -1;
+
+  /* Print 12 bytes from the input file. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/c-12.txt",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "12",
+                 "test/files/10.txt",
+                 NULL);
+
+  /* Print 0 bytes from the input file. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/0.txt",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "0",
+                 "test/files/10.txt",
+                 NULL);
+
+  /* Byte count larger than the file, from multiple files. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-c100-10-5-no-eol.txt",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "100",
+                 "test/files/10.txt",
+                 "test/files/5-no-eol.txt",
+                 NULL);
+
+  /* The last of (-c) and (-n) wins. */
+  test_head_main("5",
+                 NULL,
+                 0,
+                 "test/files/5.txt",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "12",
+                 "-n",
+                 "5",
+                 "test/files/10.txt",
+                 NULL);
+
+  /* Print bytes from the mapping when the kernel refuses to copy them. */
+  g_test_seam_err_ctr_copy_file_range = 0;
+  g_test_seam_copy_errno = EXDEV;
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/c-12.txt",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "12",
+                 "test/files/10.txt",
+                 NULL);
+  g_test_seam_copy_errno = EIO;
+  g_test_seam_err_ctr_copy_file_range = -1;
+
+  /* Read bytes when the file cannot get mapped either. */
+  g_test_seam_err_ctr_copy_file_range = 0;
+  g_test_seam_err_ctr_mmap = 0;
+  g_test_seam_copy_errno = EXDEV;
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/c-12.txt",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "12",
+                 "test/files/10.txt",
+                 NULL);
+  g_test_seam_copy_errno = EIO;
+  g_test_seam_err_ctr_mmap = -1;
+  g_test_seam_err_ctr_copy_file_range = -1;
+
+  /* Print all but the last lines or bytes. */
+  for(i = 0; i < 2; i++){
+    g_test_seam_err_ctr_copy_file_range = i - 1;
+    g_test_seam_copy_errno = EXDEV;
+    test_head_main("-3",
+                   NULL,
+                   0,
+                   "test/files/7.txt",
+                   EXIT_SUCCESS,
+                   "test/files/10.txt",
+                   NULL);
+    test_head_main("-2",
+                   NULL,
+                   0,
+                   "test/files/3.txt",
+                   EXIT_SUCCESS,
+                   "test/files/5-no-eol.txt",
+                   NULL);
+  }
+  g_test_seam_copy_errno = EIO;
+  g_test_seam_err_ctr_copy_file_range = -1;
+  test_head_main("-20",
+                 NULL,
+                 0,
+                 "test/files/0.txt",
+                 EXIT_SUCCESS,
+                 "test/files/10.txt",
+                 NULL);
+  test_head_main("-0",
+                 NULL,
+                 0,
+                 "test/files/10.txt",
+                 EXIT_SUCCESS,
+                 "test/files/10.txt",
+                 NULL);
+  test_head_main("-2",
+                 NULL,
+                 0,
+                 "build/test-rand.txt.98",
+                 EXIT_SUCCESS,
+                 "build/test-rand.txt",
+                 NULL);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/c-elide-5.txt",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "-5",
+                 "test/files/10.txt",
+                 NULL);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/0.txt",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "-200",
+                 "test/files/10.txt",
+                 NULL);
+
+  /* Print files in parallel, more files than fit the output window. */
+  test_head_main("5",
+                 NULL,
+                 0,
+                 "test/files/comb-j-8.txt",
+                 EXIT_SUCCESS,
+                 "-j",
+                 "2",
+                 "test/files/1.txt",
+                 "test/files/10.txt",
+                 "test/files/5-no-eol.txt",
+                 "test/files/0.txt",
+                 "test/files/10.txt",
+                 "test/files/1.txt",
+                 "test/files/5.txt",
+                 "test/files/10.txt",
+                 NULL);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-1-10-1.txt",
+                 EXIT_SUCCESS,
+                 "-j",
+                 "8",
+                 "test/files/1.txt",
+                 "test/files/10.txt",
+                 "test/files/1.txt",
+                 NULL);
+
+  /* Print many files through io_uring, or serially if not available. */
+  for(i = -1; i < 1; i++){
+    g_test_seam_err_ctr_syscall = i;
+    test_head_main("5",
+                   NULL,
+                   0,
+                   "test/files/comb-j-8.txt",
+                   EXIT_SUCCESS,
+                   "test/files/1.txt",
+                   "test/files/10.txt",
+                   "test/files/5-no-eol.txt",
+                   "test/files/0.txt",
+                   "test/files/10.txt",
+                   "test/files/1.txt",
+                   "test/files/5.txt",
+                   "test/files/10.txt",
+                   NULL);
+  }
+  g_test_seam_err_ctr_syscall = -1;
+
+  /* Print files serially when no worker thread can get started. */
+  g_test_seam_err_ctr_pthread_create = 0;
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-1-10-1.txt",
+                 EXIT_SUCCESS,
+                 "-j",
+                 "2",
+                 "test/files/1.txt",
+                 "test/files/10.txt",
+                 "test/files/1.txt",
+                 NULL);
+  g_test_seam_err_ctr_pthread_create = -1;
+
+  /* Keep going with the worker threads that did start. */
+  g_test_seam_err_ctr_pthread_create = 1;
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/comb-1-10-1.txt",
+                 EXIT_SUCCESS,
+                 "-j",
+                 "2",
+                 "test/files/1.txt",
+                 "test/files/10.txt",
+                 "test/files/1.txt",
+                 NULL);
+  g_test_seam_err_ctr_pthread_create = -1;
+
+  /* Compressed files get printed as is unless asked to decompress. */
+  fp = fopen("test/files/10.txt.gz", "r");
+  assert(fp);
+  assert(fread(raw, 1, sizeof(raw), fp) == sizeof(raw));
+  assert(fclose(fp) == 0);
+  test_write_file("build/test-gz.ref", raw, sizeof(raw));
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "build/test-gz.ref",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "12",
+                 "test/files/10.txt.gz",
+                 NULL);
+
+#ifdef HEAD_ZLIB
+  /* Decompress gzip files. */
+  test_head_main("5",
+                 NULL,
+                 0,
+                 "test/files/5.txt",
+                 EXIT_SUCCESS,
+                 "--decompress",
+                 "test/files/10.txt.gz",
+                 NULL);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/c-12.txt",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "12",
+                 "--decompress",
+                 "test/files/10.txt.gz",
+                 NULL);
+
+  /* Concatenated gzip members. */
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/5-5.txt",
+                 EXIT_SUCCESS,
+                 "--decompress",
+                 "test/files/5-5.txt.gz",
+                 NULL);
+
+  /* Stop decompressing before reaching the truncated end of the file. */
+  test_head_main("10",
+                 NULL,
+                 0,
+                 "test/files/10.txt",
+                 EXIT_SUCCESS,
+                 "--decompress",
+                 "test/files/10-repeat-truncated.txt.gz",
+                 NULL);
+
+  /* Hold back the last lines or bytes of the decompressed data. */
+  test_head_main("-5",
+                 NULL,
+                 0,
+                 "test/files/5.txt",
+                 EXIT_SUCCESS,
+                 "--decompress",
+                 "test/files/10.txt.gz",
+                 NULL);
+  test_head_main("-5",
+                 NULL,
+                 0,
+                 "test/files/5.txt",
+                 EXIT_SUCCESS,
+                 "--decompress",
+                 "test/files/5-5.txt.gz",
+                 NULL);
+  test_head_main(NULL,
+                 NULL,
+                 0,
+                 "test/files/c-12.txt",
+                 EXIT_SUCCESS,
+                 "-c",
+                 "-90",
+                 "--decompress",
+                 "test/files/10.txt.gz",
+                 NULL);
+
+  /* Truncated file while holding back the last lines. */
+  test_head_main("-1",
+                 NULL,
+                 0,
+                 NULL,
+                 EXIT_FAILURE,
+                 "--decompress",
+                 "test/files/10-repeat-truncated.txt.gz",
+                 NULL);
+
+  /* Decompress gzip files opened through io_uring. */
+  test_head_main("5",
+                 NULL,
+                 0,
+                 "test/files/comb-gz-8.txt",
+                 EXIT_SUCCESS,
+                 "--decompress",
+                 "test/files/10.txt.gz",
+                 "test/files/1.txt",
+                 "test/files/1.txt",
+                 "test/files/1.txt",
+                 "test/files/1.txt",
+                 "test/files/1.txt",
+                 "test/files/1.txt",
+                 "test/files/1.txt",
+                 NULL);
+#endif /* HEAD_ZLIB */
+
+  /* Character device without a mappable size. */
+  test_head_main("0",
+                 NULL,
+                 0,
+                 "test/files/0.txt",
+                 EXIT_SUCCESS,
+                 "/dev/null",
                  NULL);
 
+  test_all_scan();
+  test_all_long_line();
+  test_all_index();
+  test_all_delim();
+  test_all_sparse();
+  test_all_pscan();
+  test_all_files_from();
+  test_all_serve();
+  test_all_prefetch();
+  test_all_resume();
   test_all_stdin();
+  test_all_stdin_offset();
+  test_all_stats();
+  test_all_lib();
   test_all_errors();
 }
 
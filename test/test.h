@@ -8,41 +8,139 @@
 #ifndef HEAD_TEST_H
 #define HEAD_TEST_H
 
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <unistd.h>
 
-int
-head_main(int argc,
-          char *argv[]);
+#include "../src/head.h"
 
-int
-test_seam_fclose(FILE *stream);
+size_t
+head_rscan(const char *const buf,
+           const size_t len,
+           const int delim,
+           uintmax_t *const nlines);
 
-int
-test_seam_ferror(FILE *stream);
+size_t
+head_scan_scalar(const char *const buf,
+                 const size_t len,
+                 const int delim,
+                 uintmax_t *const nlines);
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+size_t
+head_scan_sse2(const char *const buf,
+               const size_t len,
+               const int delim,
+               uintmax_t *const nlines);
 
 size_t
-test_seam_fwrite(const void *ptr,
-                 size_t size,
-                 size_t nitems,
-                 FILE *stream);
+head_scan_avx2(const char *const buf,
+               const size_t len,
+               const int delim,
+               uintmax_t *const nlines);
+#endif /* __GNUC__ && (__x86_64__ || __i386__) */
+
+int
+test_seam_close(int fildes);
 
 ssize_t
-test_seam_getline(char **lineptr,
-                  size_t *n,
-                  FILE *stream);
+test_seam_copy_file_range(int fd_in,
+                          loff_t *off_in,
+                          int fd_out,
+                          loff_t *off_out,
+                          size_t len,
+                          unsigned int flags);
 
 int
-test_seam_printf(const char *format, ...);
+test_seam_fstat(int fildes,
+                struct stat *buf);
+
+off_t
+test_seam_lseek(int fildes,
+                off_t offset,
+                int whence);
+
+void *
+test_seam_malloc(size_t size);
+
+void *
+test_seam_mmap(void *addr,
+               size_t len,
+               int prot,
+               int flags,
+               int fildes,
+               off_t off);
 
 int
-test_seam_putchar(int c);
-
-extern int g_test_seam_err_ctr_fclose;
-extern int g_test_seam_err_ctr_ferror;
-extern int g_test_seam_err_ctr_fwrite;
-extern int g_test_seam_err_ctr_getline;
-extern int g_test_seam_err_ctr_printf;
-extern int g_test_seam_err_ctr_putchar;
+test_seam_munmap(void *addr,
+                 size_t len);
+
+int
+test_seam_pthread_create(pthread_t *thread,
+                         const pthread_attr_t *attr,
+                         void *(*start_routine)(void *),
+                         void *arg);
+
+ssize_t
+test_seam_pread(int fildes,
+                void *buf,
+                size_t nbyte,
+                off_t offset);
+
+ssize_t
+test_seam_read(int fildes,
+               void *buf,
+               size_t nbyte);
+
+void *
+test_seam_realloc(void *ptr,
+                  size_t size);
+
+ssize_t
+test_seam_sendfile(int out_fd,
+                   int in_fd,
+                   off_t *offset,
+                   size_t count);
+
+ssize_t
+test_seam_splice(int fd_in,
+                 loff_t *off_in,
+                 int fd_out,
+                 loff_t *off_out,
+                 size_t len,
+                 unsigned int flags);
+
+long
+test_seam_syscall(long number, ...);
+
+ssize_t
+test_seam_writev(int fildes,
+                 const struct iovec *iov,
+                 int iovcnt);
+
+extern int g_test_seam_err_ctr_close;
+extern int g_test_seam_err_ctr_copy_file_range;
+extern int g_test_seam_err_ctr_fstat;
+extern int g_test_seam_err_ctr_lseek;
+extern int g_test_seam_err_ctr_malloc;
+extern int g_test_seam_err_ctr_mmap;
+extern int g_test_seam_err_ctr_munmap;
+extern int g_test_seam_err_ctr_pthread_create;
+extern int g_test_seam_err_ctr_pread;
+extern int g_test_seam_err_ctr_read;
+extern int g_test_seam_err_ctr_realloc;
+extern int g_test_seam_err_ctr_sendfile;
+extern int g_test_seam_err_ctr_splice;
+extern int g_test_seam_err_ctr_syscall;
+extern int g_test_seam_err_ctr_writev;
+
+extern int g_test_seam_copy_errno;
+
+extern const size_t g_head_mmap_window;
+extern size_t g_head_pscan_chunk;
 
 #endif /* HEAD_TEST_H */
 